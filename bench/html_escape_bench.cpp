@@ -0,0 +1,116 @@
+// Microbenchmark: cost of HTML-escaping {{ }} substitutions.
+//
+//   html_escape_bench [rows]
+//
+// Times HtmlEscape::findSpecial() per SIMD level on clean and dirty input, then
+// renders a large HtmlReportBuilder report twice: through the stock template
+// (cell values escaped) and through a copy using {{{ }}} (written raw).
+#include "html_escape.h"
+#include "html_report_builder.h"
+#include "template_engine.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+
+namespace {
+
+// Keeps the optimizer from discarding the timed calls
+volatile size_t benchSink = 0;
+
+template <typename Fn>
+double bestOf3Ms(Fn&& fn) {
+    double best = 0;
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (round == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+// Escape every value in turn, as rendering does
+double escapeValuesMs(const std::vector<std::string>& values, TemplateScanner::Level level) {
+    return bestOf3Ms([&] {
+        size_t total = 0;
+        for (const auto& value : values) {
+            const char* data = value.data();
+            size_t size = value.size();
+            while (size > 0) {
+                size_t clean = HtmlEscape::findSpecial(data, size, level);
+                total += clean + (clean < size ? HtmlEscape::entity(data[clean]).size() : 0);
+                if (clean == size) break;
+                data += clean + 1;
+                size -= clean + 1;
+            }
+        }
+        benchSink = benchSink + total;
+    });
+}
+
+std::string replaceAll(std::string text, const std::string& from, const std::string& to) {
+    for (size_t pos = text.find(from); pos != std::string::npos; pos = text.find(from, pos + to.size())) {
+        text.replace(pos, from.size(), to);
+    }
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int rows = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if (rows <= 0) rows = 100000;
+
+    // Typical cell values: short, mostly clean; a few customer names need escaping
+    std::vector<std::string> shortValues;
+    std::vector<std::string> longValues;
+    for (int i = 0; i < rows; ++i) {
+        shortValues.push_back(fmt::format("{:.2f}", i * 1.25));
+        shortValues.push_back(i % 50 == 0 ? "Tan & Sons <Klang>" : fmt::format("Customer {}", i));
+        longValues.push_back(fmt::format("Lot {} / 123 Jalan Besar, Taman Perindustrian, 41050 Klang, Selangor", i));
+    }
+    std::string clean(1 << 20, 'x');
+
+    const std::vector<TemplateScanner::Level> levels = {
+        TemplateScanner::Level::Scalar, TemplateScanner::Level::SSE2, TemplateScanner::Level::AVX2};
+    TemplateScanner::Level detected = TemplateScanner::detectedLevel();
+
+    std::cout << "CPU level: " << TemplateScanner::levelName(detected) << "\n\n";
+    std::cout << fmt::format("{:<8} {:>16} {:>16} {:>16}\n", "level", "short values ms", "long values ms", "1MB clean us");
+    for (auto level : levels) {
+        if (level > detected) continue;
+        double shortMs = escapeValuesMs(shortValues, level);
+        double longMs = escapeValuesMs(longValues, level);
+        double cleanUs = 1000.0 * bestOf3Ms([&] { benchSink = benchSink + HtmlEscape::findSpecial(clean.data(), clean.size(), level); });
+        std::cout << fmt::format("{:<8} {:>16.2f} {:>16.2f} {:>16.1f}\n", TemplateScanner::levelName(level), shortMs, longMs, cleanUs);
+    }
+
+    HtmlReportBuilder report("Debtor Ageing <All>", "Outlet & Co", "Landscape");
+    report.addColumn("Code", 1);
+    report.addColumn("Customer", 3);
+    report.addColumn("Address", 5);
+    report.addColumn("Amount", 1.5, true);
+    for (int i = 0; i < rows; ++i) {
+        report.addRow({fmt::format("C{:06}", i), shortValues[2 * i + 1], longValues[i], shortValues[2 * i]});
+    }
+    TemplateContext ctx = report.buildContext();
+
+    const CompiledTemplate& escaped = TemplateEngine::getCompiledTabularReportTemplate();
+    CompiledTemplate raw = TemplateEngine::compile(
+        replaceAll(TemplateEngine::getTabularReportTemplate(), "{{value}}", "{{{value}}}"));
+
+    std::string out;
+    double escapedMs = bestOf3Ms([&] { out.clear(); escaped.render(ctx, out); });
+    size_t escapedBytes = out.size();
+    double rawMs = bestOf3Ms([&] { out.clear(); raw.render(ctx, out); });
+
+    std::cout << fmt::format("\nTabular report, {} rows x 4 columns\n", rows);
+    std::cout << fmt::format("  {{{{{{value}}}}}} raw     {:>9.1f} ms  {:>11} bytes\n", rawMs, out.size());
+    std::cout << fmt::format("  {{{{value}}}} escaped   {:>9.1f} ms  {:>11} bytes  ({:+.1f}%)\n", escapedMs, escapedBytes,
+                             100.0 * (escapedMs - rawMs) / rawMs);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Benchmark: wkhtmltopdf conversion time and PDF size per RenderProfile.
+//
+//   render_profile_bench [rows] [iterations]
+//
+// Renders every built-in template with generated sample data (each {{key}} set,
+// each {{#if}} true, each {{#each}} given rows items; {{{raw}}} values are left
+// empty, and AssetCache clears image keys as it does for a document whose image
+// cannot be read) and converts it to a buffer under each profile. Reports the
+// best time of the iterations and the output size. Needs a real libwkhtmltox.
+#include "asset_cache.h"
+#include "pdf_generator.h"
+#include "template_engine.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fmt/format.h>
+
+namespace {
+
+using Nodes = std::vector<CompiledTemplate::Node>;
+
+// Give every name the nodes read a value, so the page looks like a filled-in document
+void fillSample(const Nodes& nodes, TemplateVariables& variables, TemplateLists& lists, int rows, int depth) {
+    for (const auto& node : nodes) {
+        switch (node.type) {
+            case CompiledTemplate::Node::Type::Variable:
+                if (!node.raw) variables[node.key] = fmt::format("{} {}", node.name, rows);
+                break;
+            case CompiledTemplate::Node::Type::If:
+                variables[node.key] = true;
+                fillSample(node.children, variables, lists, rows, depth);
+                break;
+            case CompiledTemplate::Node::Type::Each: {
+                // Nested lists get a few items each, not rows
+                int count = depth == 0 ? rows : 3;
+                auto& items = lists[node.key];
+                items.resize(count);
+                for (int i = 0; i < count; ++i) fillSample(node.children, items[i].fields, items[i].lists, i + 1, depth + 1);
+                break;
+            }
+            case CompiledTemplate::Node::Type::Fragment:
+                fillSample(node.children, variables, lists, rows, depth);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int rows = argc > 1 ? std::atoi(argv[1]) : 40;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 3;
+    if (rows <= 0) rows = 40;
+    if (iterations <= 0) iterations = 3;
+
+    if (!PdfGenerator::initLibrary()) {
+        std::cerr << "wkhtmltopdf failed to initialize\n";
+        return 1;
+    }
+
+    const std::vector<std::pair<const char*, const CompiledTemplate*>> templates = {
+        {"invoice", &TemplateEngine::getCompiledInvoiceTemplate()},
+        {"report", &TemplateEngine::getCompiledReportTemplate()},
+        {"letter", &TemplateEngine::getCompiledLetterTemplate()},
+        {"sales summary", &TemplateEngine::getCompiledSalesSummaryTemplate()},
+        {"purchase summary", &TemplateEngine::getCompiledPurchaseSummaryTemplate()},
+        {"poison order", &TemplateEngine::getCompiledPoisonOrderTemplate()},
+        {"billing statement", &TemplateEngine::getCompiledBillingStatementTemplate()},
+        {"purchase order", &TemplateEngine::getCompiledPurchaseOrderTemplate()},
+        {"tabular report", &TemplateEngine::getCompiledTabularReportTemplate()},
+    };
+    const std::vector<RenderProfile> profiles = {
+        RenderProfile::Default, RenderProfile::Fast, RenderProfile::Balanced, RenderProfile::Quality};
+
+    std::cout << fmt::format("{} rows per list, best of {}\n\n", rows, iterations);
+    std::cout << fmt::format("{:<18} {:<9} {:>10} {:>8} {:>12} {:>8}\n", "template", "profile", "ms", "vs def", "bytes", "vs def");
+    int failures = 0;
+    for (const auto& [name, compiled] : templates) {
+        TemplateContext ctx;
+        fillSample(compiled->nodes(), ctx.variables, ctx.lists, rows, 0);
+        AssetCache::shared().inlineImages(ctx);
+        std::string html = compiled->render(ctx);
+
+        double defaultMs = 0;
+        size_t defaultBytes = 0;
+        for (RenderProfile profile : profiles) {
+            PdfConfig config;
+            config.profile = profile;
+            PdfGenerator generator(config);
+
+            double best = 0;
+            std::string pdf;
+            bool ok = true;
+            for (int round = 0; round < iterations && ok; ++round) {
+                pdf.clear();
+                auto start = std::chrono::steady_clock::now();
+                ok = generator.generateToBuffer(html, pdf);
+                auto end = std::chrono::steady_clock::now();
+                double ms = std::chrono::duration<double, std::milli>(end - start).count();
+                if (round == 0 || ms < best) best = ms;
+            }
+            if (!ok) {
+                std::cout << fmt::format("{:<18} {:<9} conversion failed\n", name, renderProfileName(profile));
+                ++failures;
+                continue;
+            }
+            if (profile == RenderProfile::Default) {
+                defaultMs = best;
+                defaultBytes = pdf.size();
+            }
+            double msChange = defaultMs > 0 ? 100.0 * (best - defaultMs) / defaultMs : 0;
+            double bytesChange = defaultBytes > 0 ? 100.0 * (double(pdf.size()) - double(defaultBytes)) / double(defaultBytes) : 0;
+            std::cout << fmt::format("{:<18} {:<9} {:>10.1f} {:>7.1f}% {:>12} {:>7.1f}%\n", name, renderProfileName(profile),
+                                     best, msChange, pdf.size(), bytesChange);
+        }
+    }
+
+    PdfGenerator::deinitLibrary();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// Microbenchmark: template lexer, std::string::find loops vs TemplateScanner.
+//
+//   template_scan_bench [iterations]
+//
+// Runs over every built-in template and three synthetic ~1 MB sources
+// (repeated invoice markup, tag-dense table rows, plain text with sparse tags).
+// Each scanner level is checked against the find loop before it is timed.
+#include "template_engine.h"
+#include "template_scanner.h"
+#include "template_strings.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+
+namespace {
+
+constexpr size_t kSyntheticSize = 1 << 20;
+
+// Keeps the optimizer from discarding the timed calls
+volatile size_t benchSink = 0;
+
+// The tag search compile() used before TemplateScanner: one find() per delimiter
+std::vector<TemplateToken> tokenizeWithFind(const std::string& src) {
+    std::vector<TemplateToken> tokens;
+    size_t pos = 0;
+    while (pos < src.size()) {
+        size_t tagStart = src.find("{{", pos);
+        if (tagStart == std::string::npos) break;
+        TemplateToken token;
+        token.begin = tagStart;
+        token.raw = tagStart + 2 < src.size() && src[tagStart + 2] == '{';
+        size_t close = src.find(token.raw ? "}}}" : "}}", token.innerBegin());
+        if (close == std::string::npos) break;
+        token.end = close + (token.raw ? 3 : 2);
+        tokens.push_back(token);
+        pos = token.end;
+    }
+    return tokens;
+}
+
+bool sameTokens(const std::vector<TemplateToken>& a, const std::vector<TemplateToken>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].begin != b[i].begin || a[i].end != b[i].end || a[i].raw != b[i].raw) return false;
+    }
+    return true;
+}
+
+std::string repeatToSize(const std::string& unit) {
+    std::string out;
+    out.reserve(kSyntheticSize + unit.size());
+    while (out.size() < kSyntheticSize) out += unit;
+    return out;
+}
+
+// Best-of-3 average time per call in microseconds
+template <typename Fn>
+double timeIt(int iterations, Fn&& fn) {
+    double best = 0;
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) benchSink = benchSink + fn().size();
+        auto end = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+        if (round == 0 || us < best) best = us;
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200;
+    if (iterations <= 0) iterations = 200;
+
+    std::vector<std::pair<std::string, std::string>> inputs = {
+        {"invoice", TemplateEngine::getInvoiceTemplate()},
+        {"report", TemplateEngine::getReportTemplate()},
+        {"letter", TemplateEngine::getLetterTemplate()},
+        {"sales_summary", TemplateEngine::getSalesSummaryTemplate()},
+        {"purchase_summary", TemplateEngine::getPurchaseSummaryTemplate()},
+        {"poison_order", TemplateEngine::getPoisonOrderTemplate()},
+        {"billing_statement", TemplateEngine::getBillingStatementTemplate()},
+        {"purchase_order", TemplateEngine::getPurchaseOrderTemplate()},
+        {"tabular_report", TemplateEngine::getTabularReportTemplate()},
+        {"1MB invoices", repeatToSize(TemplateEngine::getInvoiceTemplate())},
+        {"1MB dense rows", repeatToSize("<tr><td>{{code}}</td><td>{{{name}}}</td><td class=\"r\">{{qty}}</td></tr>\n")},
+        {"1MB sparse text", repeatToSize(std::string(4000, 'x') + " {{page_no}} " + std::string(4000, ' ') + "\n")},
+    };
+
+    const std::vector<TemplateScanner::Level> levels = {
+        TemplateScanner::Level::Scalar, TemplateScanner::Level::SSE2, TemplateScanner::Level::AVX2};
+    TemplateScanner::Level detected = TemplateScanner::detectedLevel();
+
+    std::cout << "CPU level: " << TemplateScanner::levelName(detected) << ", " << iterations << " iterations\n\n";
+    std::cout << fmt::format("{:<18} {:>9} {:>6} {:>11}", "input", "bytes", "tags", "find (us)");
+    for (auto level : levels) {
+        if (level <= detected) std::cout << fmt::format(" {:>13}", fmt::format("{} (us)", TemplateScanner::levelName(level)));
+    }
+    std::cout << fmt::format(" {:>9}\n", "speedup");
+
+    bool allMatch = true;
+    for (const auto& [name, src] : inputs) {
+        // Scale iterations down for the large inputs so each row takes similar time
+        int runs = src.size() > 100000 ? (iterations + 19) / 20 : iterations;
+        auto expected = tokenizeWithFind(src);
+        double findUs = timeIt(runs, [&] { return tokenizeWithFind(src); });
+        std::cout << fmt::format("{:<18} {:>9} {:>6} {:>11.1f}", name, src.size(), expected.size(), findUs);
+
+        double bestUs = 0;
+        for (auto level : levels) {
+            if (level > detected) continue;
+            if (!sameTokens(expected, TemplateScanner::tokenize(src, level))) {
+                std::cout << fmt::format(" {:>13}", "MISMATCH");
+                allMatch = false;
+                continue;
+            }
+            double us = timeIt(runs, [&] { return TemplateScanner::tokenize(src, level); });
+            if (bestUs == 0 || us < bestUs) bestUs = us;
+            std::cout << fmt::format(" {:>13.1f}", us);
+        }
+        // Below 1.00x the best scanner level loses to the find loop
+        std::cout << fmt::format(" {:>8.2f}x\n", bestUs > 0 ? findUs / bestUs : 0.0);
+    }
+    return allMatch ? 0 : 1;
+}
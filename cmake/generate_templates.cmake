@@ -1,5 +1,11 @@
 # CMake script to generate C++ header from HTML templates
 # Usage: cmake -DTEMPLATES_DIR=<path> -DOUTPUT_FILE=<path> -P generate_templates.cmake
+#
+# Besides the raw string literals, each template is tokenized here into a
+# TemplateTable (see template_engine.h): text spans as offsets into the literal,
+# variable/list names as indexes into a key table, and {{#if}}/{{#each}} ops with
+# the indexes of their {{else}} and closing ops. TemplateEngine builds the
+# compiled form straight from these tables without scanning the text.
 
 if(NOT DEFINED TEMPLATES_DIR)
     message(FATAL_ERROR "TEMPLATES_DIR not defined")
@@ -16,6 +22,181 @@ function(file_to_cpp_string FILEPATH VAR_NAME OUTPUT_VAR)
     set(${OUTPUT_VAR} "R\"(${FILE_CONTENT})\"" PARENT_SCOPE)
 endfunction()
 
+# Helper: index of KEY in the key table list, appending it if new
+macro(template_key_index KEY OUT_INDEX)
+    list(FIND _keys "${KEY}" ${OUT_INDEX})
+    if(${OUT_INDEX} EQUAL -1)
+        list(LENGTH _keys ${OUT_INDEX})
+        list(APPEND _keys "${KEY}")
+    endif()
+endmacro()
+
+# Helper: append an op "<code>|<value>|<length>|<elseOp>|<endOp>"
+macro(template_add_op CODE VALUE LENGTH)
+    list(APPEND _ops "${CODE}|${VALUE}|${LENGTH}|0|0")
+endmacro()
+
+# Helper: replace field FIELD (3 = elseOp, 4 = endOp) of op OP_INDEX with VALUE
+macro(template_patch_op OP_INDEX FIELD VALUE)
+    list(GET _ops ${OP_INDEX} _op)
+    string(REPLACE "|" ";" _fields "${_op}")
+    list(REMOVE_AT _fields ${FIELD})
+    list(INSERT _fields ${FIELD} ${VALUE})
+    string(REPLACE ";" "|" _op "${_fields}")
+    list(REMOVE_AT _ops ${OP_INDEX})
+    list(INSERT _ops ${OP_INDEX} "${_op}")
+endmacro()
+
+# Tokenize FILEPATH with the same rules as TemplateEngine::compile(const std::string&)
+# and set OUTPUT_VAR to C++ definitions of <NAME>Ops/<NAME>Keys and get<NAME>Table().
+# Templates with unclosed blocks get an empty table and are parsed at runtime.
+function(tokenize_template FILEPATH NAME OUTPUT_VAR)
+    file(READ "${FILEPATH}" content)
+    string(LENGTH "${content}" total)
+    set(_ops "")
+    set(_keys "")
+    set(_open "")       # indexes of If/Each ops still waiting for their closing tag
+    set(_in_else "")    # parallel to _open: 1 once {{else}} was seen
+    set(pos 0)
+
+    while(pos LESS total)
+        string(SUBSTRING "${content}" ${pos} -1 rest)
+        string(FIND "${rest}" "{{" rel)
+        if(rel EQUAL -1)
+            math(EXPR len "${total} - ${pos}")
+            template_add_op(Text ${pos} ${len})
+            break()
+        endif()
+        if(rel GREATER 0)
+            template_add_op(Text ${pos} ${rel})
+        endif()
+        math(EXPR tag_start "${pos} + ${rel}")
+        math(EXPR body_start "${tag_start} + 2")
+
+        # Triple-brace {{{key}}} - unescaped variable
+        set(third "")
+        if(body_start LESS total)
+            string(SUBSTRING "${content}" ${body_start} 1 third)
+        endif()
+        if(third STREQUAL "{")
+            math(EXPR body_start "${body_start} + 1")
+            string(SUBSTRING "${content}" ${body_start} -1 rest)
+            string(FIND "${rest}" "}}}" close)
+            if(close EQUAL -1)
+                math(EXPR len "${total} - ${tag_start}")
+                template_add_op(Text ${tag_start} ${len})
+                break()
+            endif()
+            string(SUBSTRING "${rest}" 0 ${close} tag)
+            string(STRIP "${tag}" tag)
+            template_key_index("${tag}" key)
+            template_add_op(RawVariable ${key} 0)
+            math(EXPR pos "${body_start} + ${close} + 3")
+            continue()
+        endif()
+
+        string(SUBSTRING "${content}" ${body_start} -1 rest)
+        string(FIND "${rest}" "}}" close)
+        if(close EQUAL -1)
+            math(EXPR len "${total} - ${tag_start}")
+            template_add_op(Text ${tag_start} ${len})
+            break()
+        endif()
+        string(SUBSTRING "${rest}" 0 ${close} tag)
+        string(STRIP "${tag}" tag)
+        math(EXPR pos "${body_start} + ${close} + 2")
+        math(EXPR tag_len "${pos} - ${tag_start}")
+        list(LENGTH _ops op_index)
+        list(LENGTH _open depth)
+        if(depth GREATER 0)
+            list(GET _open -1 top)
+            list(GET _ops ${top} top_op)
+            string(REGEX MATCH "^[A-Za-z]+" top_code "${top_op}")
+            list(GET _in_else -1 top_in_else)
+        else()
+            set(top_code "")
+            set(top_in_else 0)
+        endif()
+
+        if(tag MATCHES "^#(if|each)[ \t\r\n]+([^ \t\r\n]+)")
+            if(CMAKE_MATCH_1 STREQUAL "if")
+                set(code If)
+            else()
+                set(code Each)
+            endif()
+            template_key_index("${CMAKE_MATCH_2}" key)
+            template_add_op(${code} ${key} 0)
+            list(APPEND _open ${op_index})
+            list(APPEND _in_else 0)
+        elseif(tag STREQUAL "else")
+            # Only meaningful directly inside {{#if}}; dropped elsewhere
+            if(top_code STREQUAL "If" AND top_in_else EQUAL 0)
+                template_add_op(Else 0 0)
+                template_patch_op(${top} 3 ${op_index})
+                list(REMOVE_AT _in_else -1)
+                list(APPEND _in_else 1)
+            endif()
+        elseif((tag STREQUAL "/if" AND top_code STREQUAL "If") OR
+               (tag STREQUAL "/each" AND top_code STREQUAL "Each"))
+            template_add_op(End 0 0)
+            template_patch_op(${top} 4 ${op_index})
+            list(REMOVE_AT _open -1)
+            list(REMOVE_AT _in_else -1)
+        elseif(tag MATCHES "^[#/]")
+            # Unknown or unbalanced control tag - kept literally, like the runtime parser
+            template_add_op(Text ${tag_start} ${tag_len})
+        else()
+            template_key_index("${tag}" key)
+            template_add_op(Variable ${key} 0)
+        endif()
+    endwhile()
+
+    list(LENGTH _open depth)
+    if(depth GREATER 0)
+        message(WARNING "${FILEPATH}: unclosed {{#if}}/{{#each}} block, template will be parsed at runtime")
+        set(_ops "")
+    endif()
+
+    set(defs "")
+    list(LENGTH _ops op_count)
+    if(op_count GREATER 0)
+        list(LENGTH _keys key_count)
+        string(APPEND defs "inline const TemplateOp ${NAME}Ops[] = {\n")
+        foreach(op IN LISTS _ops)
+            string(REPLACE "|" ";" fields "${op}")
+            list(GET fields 0 code)
+            list(GET fields 1 value)
+            list(GET fields 2 length)
+            list(GET fields 3 else_op)
+            list(GET fields 4 end_op)
+            string(APPEND defs "    {TemplateOp::${code}, ${value}, ${length}, ${else_op}, ${end_op}},\n")
+        endforeach()
+        string(APPEND defs "};\n\n")
+        if(key_count GREATER 0)
+            string(APPEND defs "inline const char* const ${NAME}Keys[] = {\n")
+            foreach(key IN LISTS _keys)
+                string(REPLACE "\\" "\\\\" key "${key}")
+                string(REPLACE "\"" "\\\"" key "${key}")
+                string(APPEND defs "    \"${key}\",\n")
+            endforeach()
+            string(APPEND defs "};\n\n")
+            set(keys_ref "${NAME}Keys")
+        else()
+            set(keys_ref "nullptr")
+        endif()
+        set(ops_ref "${NAME}Ops")
+    else()
+        set(key_count 0)
+        set(ops_ref "nullptr")
+        set(keys_ref "nullptr")
+    endif()
+
+    string(APPEND defs "inline TemplateTable get${NAME}Table() {\n")
+    string(APPEND defs "    return {get${NAME}Template(), ${total}, ${ops_ref}, ${op_count}, ${keys_ref}, ${key_count}};\n")
+    string(APPEND defs "}\n")
+    set(${OUTPUT_VAR} "${defs}" PARENT_SCOPE)
+endfunction()
+
 # Read all template files
 file_to_cpp_string("${TEMPLATES_DIR}/invoice.html" "INVOICE" INVOICE_TEMPLATE)
 file_to_cpp_string("${TEMPLATES_DIR}/report.html" "REPORT" REPORT_TEMPLATE)
@@ -27,14 +208,27 @@ file_to_cpp_string("${TEMPLATES_DIR}/billing_statement.html" "BILLING_STATEMENT"
 file_to_cpp_string("${TEMPLATES_DIR}/purchase_order.html" "PURCHASE_ORDER" PURCHASE_ORDER_TEMPLATE)
 file_to_cpp_string("${TEMPLATES_DIR}/tabular_report.html" "TABULAR_REPORT" TABULAR_REPORT_TEMPLATE)
 
+# Tokenize all template files
+tokenize_template("${TEMPLATES_DIR}/invoice.html" "Invoice" INVOICE_TABLE)
+tokenize_template("${TEMPLATES_DIR}/report.html" "Report" REPORT_TABLE)
+tokenize_template("${TEMPLATES_DIR}/letter.html" "Letter" LETTER_TABLE)
+tokenize_template("${TEMPLATES_DIR}/sales_summary.html" "SalesSummary" SALES_SUMMARY_TABLE)
+tokenize_template("${TEMPLATES_DIR}/purchase_summary.html" "PurchaseSummary" PURCHASE_SUMMARY_TABLE)
+tokenize_template("${TEMPLATES_DIR}/poison_order.html" "PoisonOrder" POISON_ORDER_TABLE)
+tokenize_template("${TEMPLATES_DIR}/billing_statement.html" "BillingStatement" BILLING_STATEMENT_TABLE)
+tokenize_template("${TEMPLATES_DIR}/purchase_order.html" "PurchaseOrder" PURCHASE_ORDER_TABLE)
+tokenize_template("${TEMPLATES_DIR}/tabular_report.html" "TabularReport" TABULAR_REPORT_TABLE)
+
 # Generate the header file
-file(WRITE "${OUTPUT_FILE}" 
+file(WRITE "${OUTPUT_FILE}"
 "// Auto-generated file - DO NOT EDIT
 // Generated from HTML templates in htmlToPDF/templates/
 // Regenerate by running: cmake --build . --target generate_templates
 
 #pragma once
 
+#include \"template_engine.h\"
+
 namespace TemplateStrings {
 
 inline const char* getInvoiceTemplate() {
@@ -73,6 +267,17 @@ inline const char* getTabularReportTemplate() {
     return ${TABULAR_REPORT_TEMPLATE};
 }
 
+// ---- Pre-tokenized tables ----
+
+${INVOICE_TABLE}
+${REPORT_TABLE}
+${LETTER_TABLE}
+${SALES_SUMMARY_TABLE}
+${PURCHASE_SUMMARY_TABLE}
+${POISON_ORDER_TABLE}
+${BILLING_STATEMENT_TABLE}
+${PURCHASE_ORDER_TABLE}
+${TABULAR_REPORT_TABLE}
 } // namespace TemplateStrings
 ")
 
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "template_engine.h"
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Images referenced by documents (outlet logos, letterheads), read once and
+// kept as base64 data: URIs. Substituting the URI into the context before
+// rendering means WebKit decodes the image from the HTML instead of opening
+// the file on every conversion, so conversions can run with local file
+// access turned off (the PdfConfig and PdfSettings default).
+//
+// Like TemplateRegistry, a file is re-checked (mtime and size) at most once
+// per check interval and read again only when it changed. The least recently
+// used images are dropped beyond a byte budget. Thread-safe; files are read
+// and encoded outside the lock.
+class AssetCache {
+public:
+    using DataUri = std::shared_ptr<const std::string>;
+
+    struct Stats {
+        size_t hits = 0;
+        size_t loads = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    explicit AssetCache(size_t maxBytes = 32u << 20,
+                        std::chrono::milliseconds checkInterval = std::chrono::milliseconds(2000));
+
+    // data: URI for the image at path (a file path or file:// URL), or nullptr
+    // if it cannot be read or is not a PNG, JPEG, GIF, WebP, BMP or SVG image
+    DataUri dataUri(const std::string& path);
+
+    // Replace each listed variable that names a readable image with its data: URI.
+    // Values that are already URLs (data:, http:, https:) are left as they are;
+    // paths that cannot be inlined are cleared, so the template's {{#if}} around
+    // the image skips it. Returns the number of variables replaced.
+    size_t inlineImages(TemplateContext& context,
+                        std::initializer_list<std::string_view> keys = {"outlet_logo", "letterhead_image"});
+
+    void setCheckInterval(std::chrono::milliseconds interval);
+    void clear();
+    Stats stats() const;
+
+    // Process-wide cache for callers that do not keep their own
+    static AssetCache& shared();
+
+private:
+    // An image file as last read
+    struct Entry {
+        DataUri uri;
+        std::filesystem::file_time_type mtime;
+        uintmax_t size = 0;
+        std::chrono::steady_clock::time_point checkedAt;
+        uint64_t lastUse = 0;
+    };
+
+    // Reads and encodes the file; called without mutex_
+    static DataUri load(const std::filesystem::path& path, uintmax_t size);
+    void evict();  // called with mutex_ held
+
+    mutable std::mutex mutex_;
+    size_t maxBytes_;
+    std::chrono::milliseconds checkInterval_;
+    std::unordered_map<std::string, Entry> entries_;
+    size_t bytes_ = 0;
+    uint64_t useClock_ = 0;
+    size_t hits_ = 0;
+    size_t loads_ = 0;
+};
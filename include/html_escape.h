@@ -0,0 +1,44 @@
+#pragma once
+
+#include "template_scanner.h"
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// HTML escaping for {{ }} substitutions: & < > " ' become entities. Values are
+// searched for those characters with the same SIMD level as TemplateScanner,
+// so clean strings (the common case) are handed to the sink in one piece.
+class HtmlEscape {
+public:
+    // Offset of the first character that needs escaping, or size if none does
+    static size_t findSpecial(const char* data, size_t size);
+    static size_t findSpecial(const char* data, size_t size, TemplateScanner::Level level);
+
+    // Entity for a character reported by findSpecial()
+    static std::string_view entity(char c);
+
+    // Feed the escaped form of [data, data + size) to append(const char*, size_t)
+    template <typename Append>
+    static void escape(const char* data, size_t size, Append&& append) {
+        while (size > 0) {
+            size_t clean = findSpecial(data, size);
+            if (clean > 0) append(data, clean);
+            if (clean == size) return;
+            std::string_view replacement = entity(data[clean]);
+            append(replacement.data(), replacement.size());
+            data += clean + 1;
+            size -= clean + 1;
+        }
+    }
+
+    static void escape(std::string_view input, std::string& out) {
+        escape(input.data(), input.size(), [&out](const char* data, size_t size) { out.append(data, size); });
+    }
+
+    static std::string escape(std::string_view input) {
+        std::string out;
+        out.reserve(input.size());
+        escape(input, out);
+        return out;
+    }
+};
@@ -90,6 +90,9 @@ private:
     // Track page count
     int pageCount_ = 0;
 
+    // Sections converted per wkhtmltopdf job (0 = whole report in one job)
+    int chunkPages_ = 0;
+
     // Owning pointer to XLSColumnFormatter (used by AppendToPDF)
     void* formatterPtr_ = nullptr;
     std::function<void(void*)> formatterDeleter_;
@@ -109,6 +112,13 @@ public:
     void setLineHeight(int h) { lineHeight_ = h; }
     void setBreakPageOn(bool b) { breakPageOn_ = b; }
     void setCustomCss(const std::string& css) { customCss_ = css; }
+    // Convert large reports in groups of this many sections and join the parts, so
+    // memory stays bounded by the group rather than the whole report (0 = off).
+    // Page numbers continue across groups and the footer keeps "Page N of M".
+    // M is taken to be the section count; if a section runs over a page, the
+    // groups are converted a second time with the real total. Outlines and named
+    // destinations of the parts are not carried into the joined PDF.
+    void setChunkPages(int pages) { chunkPages_ = pages; }
 
     // --- Column management ---
     void clearColumns() { columns_.clear(); }
@@ -142,6 +152,11 @@ public:
     // Render HTML string from template
     std::string renderHtml() const;
 
+    // The same for sections [firstSection, firstSection + sectionCount) only,
+    // as one group of a chunked conversion
+    TemplateContext buildContext(size_t firstSection, size_t sectionCount) const;
+    std::string renderHtml(size_t firstSection, size_t sectionCount) const;
+
     // Generate PDF file, returns the output path
     bool generatePdf(const std::string& outputPath) const;
 
@@ -149,6 +164,7 @@ public:
     bool saveAsFile(const std::wstring& filePath) const;
 
     // --- Accessors for compatibility ---
+    int chunkPages() const { return chunkPages_; }
     const std::string& title() const { return title_; }
     const std::string& outletName() const { return outletName_; }
     const std::string& orientation() const { return orientation_; }
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "pdf_generator.h"
+
+namespace htmlToPDF {
+
+// Preview images of documents through wkhtmltoimage: the same HTML a PdfGenerator
+// converts, drawn straight to a PNG or JPEG at low resolution (ImageConfig). No
+// PDF is laid out, so a thumbnail costs a fraction of the full conversion.
+//
+// wkhtmltoimage has no notion of pages, so a page is emulated: the document is
+// laid out at the paper width and the page's slice of it is cropped out, scaled
+// by dpi / 96. CSS page breaks and @page margins are not applied, so a preview
+// only approximates where the PDF breaks pages.
+//
+// Runs under PdfGenerator's lock (Qt is not thread-safe) with the same deadline,
+// cancellation and metrics handling, and caches results in a PdfCache.
+class ImageGenerator {
+public:
+    ImageGenerator();
+    explicit ImageGenerator(const ImageConfig& config);
+
+    // Call once from the main thread at startup, after PdfGenerator::initLibrary()
+    static bool initLibrary();
+    static void deinitLibrary();
+
+    // Serve repeated previews from cache (nullptr disables). Set before use; not synchronized.
+    void setCache(std::shared_ptr<PdfCache> cache) { cache_ = std::move(cache); }
+    void setJobControl(PdfJobControl control) { control_ = std::move(control); }
+
+    // Everything that determines the image; distinct from the PDF keys for the same HTML
+    static PdfCache::Key cacheKey(std::string_view html, const ImageConfig& config);
+
+    bool generateToBuffer(const std::string& htmlContent, std::string& image);
+    bool generateToFile(const std::string& htmlContent, const std::string& outputPath);
+    // The image in a PdfOutput, for code written against PdfGenerator::generateToOutput; empty on failure
+    PdfOutput generateToOutput(const std::string& htmlContent);
+
+private:
+    ImageConfig config_;
+    PdfJobControl control_;
+    std::shared_ptr<PdfCache> cache_;
+    static bool initialized_;
+
+    bool doConvert(const std::string& htmlContent, const std::string& outputPath, std::string* image);
+};
+
+} // namespace htmlToPDF
+
+using ImageGenerator = htmlToPDF::ImageGenerator;
@@ -107,7 +107,9 @@ public:
         std::vector<std::string> notes;
         std::vector<std::string> remarks;
         
-        // e-Invoice QR
+        // e-Invoice QR: the validation link, drawn as an inline SVG QR code,
+        // or else a ready-made base64 PNG
+        std::string eInvoiceUrl;
         std::string eInvoicePNG;
         
         // Theme
@@ -133,6 +135,11 @@ public:
 
     // Build template context from invoice data
     static TemplateContext buildContext(const InvoiceData& data);
+
+    // Paginate and render every page with pageTemplate (e.g. the invoice or purchase
+    // order template). Header, party block and notes are rendered once and reused.
+    static std::vector<std::string> renderPages(const CompiledTemplate& pageTemplate, const InvoiceData& data,
+                                                const PaginationConfig& config = PaginationConfig());
     
     // Helper to format color as CSS hex
     static std::string colorToHex(unsigned char r, unsigned char g, unsigned char b);
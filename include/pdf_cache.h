@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace htmlToPDF {
+
+// Rendered PDFs keyed by a SHA-256 of the final HTML, the page settings and the
+// footer version string. Reprints of the same document are then served without
+// running WebKit again. Files the HTML references by path (images, stylesheets)
+// are not hashed, so with local file access on, a changed file is not seen
+// until the entry is evicted; inline assets (AssetCache) to keep keys complete.
+//
+// The most recently used PDFs are kept in memory up to a byte budget. Entries
+// pushed out of memory are spilled to a directory (if one is set), which is
+// itself trimmed oldest-first to its own budget, and are read back on the
+// next hit. A hit returns the bytes of the first conversion, so documents
+// must not embed per-print data (timestamps, print counters) in their HTML
+// if reprints should hit; such documents simply miss. Thread-safe; disk reads
+// and writes run outside the lock that guards the memory entries.
+class PdfCache {
+public:
+    using Key = std::array<uint8_t, 32>;
+    using Bytes = std::shared_ptr<const std::string>;
+
+    // Builds a Key from length-prefixed parts, so ("ab", "c") and ("a", "bc") differ
+    class KeyBuilder {
+    public:
+        KeyBuilder();
+        KeyBuilder& add(std::string_view part);
+        KeyBuilder& add(long long value);
+        Key finish();
+
+    private:
+        void update(const uint8_t* data, size_t size);
+        void compress(const uint8_t* block);
+
+        uint32_t state_[8];
+        uint8_t block_[64];
+        size_t blockSize_ = 0;
+        uint64_t totalSize_ = 0;
+    };
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t memoryEntries = 0;
+        size_t memoryBytes = 0;
+        uint64_t diskBytes = 0;
+    };
+
+    explicit PdfCache(size_t maxMemoryBytes = 64u << 20, const std::string& spillDirectory = "",
+                      uint64_t maxDiskBytes = uint64_t(1) << 30);
+
+    // Cached PDF for key, or nullptr
+    Bytes find(const Key& key);
+    Bytes store(const Key& key, std::string pdf);
+    // Store the PDF a conversion just wrote to path
+    Bytes storeFile(const Key& key, const std::string& path);
+    // Write a cached PDF to path, as a conversion with "out" set would
+    static bool writeFile(const std::string& pdf, const std::string& path);
+
+    void clear();
+    Stats stats() const;
+
+    static std::string toHex(const Key& key);
+
+private:
+    struct Entry {
+        Key key;
+        Bytes pdf;
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    using EntryList = std::list<Entry>;
+
+    // Called with mutex_ held; entries pushed out of memory are added to spills
+    Bytes insert(const Key& key, Bytes pdf, std::vector<Entry>& spills);
+    void evict(std::vector<Entry>& spills);
+    // File I/O, called without mutex_ so it never holds up memory hits
+    void spill(const std::vector<Entry>& spills);
+    Bytes loadSpilled(const Key& key);
+    void trimDisk();  // called with diskMutex_ held
+    std::filesystem::path spillPath(const Key& key) const;
+
+    mutable std::mutex mutex_;  // memory entries and counters
+    std::mutex diskMutex_;      // spill writes, trimming and clearing of the directory
+    size_t maxMemoryBytes_;
+    uint64_t maxDiskBytes_;
+    std::filesystem::path spillDirectory_;
+    EntryList entries_;  // most recently used first
+    std::unordered_map<Key, EntryList::iterator, KeyHash> index_;
+    size_t memoryBytes_ = 0;
+    std::atomic<uint64_t> diskBytes_{0};
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+} // namespace htmlToPDF
+
+using PdfCache = htmlToPDF::PdfCache;
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "pdf_generator.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace htmlToPDF {
+
+// Headless alternative to PdfGeneratorProxy: one dedicated thread initializes
+// wkhtmltopdf and runs every conversion, so no wxWidgets event loop is needed
+// and a busy UI thread adds no latency. Callers on any thread queue requests
+// on a lock-free multi-producer queue; the thread sleeps only when it is empty.
+//
+// wkhtmltopdf must be used from the thread that initialized it, so a process
+// uses either this or PdfGeneratorProxy/PdfGenerator::initLibrary, not both.
+// Queued requests are finished before the destructor returns.
+class PdfConverterThread {
+public:
+    using CompletionCallback = std::function<void(PdfGenerateResult&&)>;
+
+    explicit PdfConverterThread(const PdfConfig& config = PdfConfig(), std::shared_ptr<PdfCache> cache = nullptr);
+    ~PdfConverterThread();
+
+    PdfConverterThread(const PdfConverterThread&) = delete;
+    PdfConverterThread& operator=(const PdfConverterThread&) = delete;
+
+    // Process-wide instance for code that does not own one, started on first use
+    static PdfConverterThread& shared();
+
+    // Same contracts as the PdfGeneratorProxy methods of the same name: queue the
+    // request and wait for it. generateToBuffer uses the config given at construction.
+    bool generateFromHtml(std::string htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateFromHtml(std::shared_ptr<const std::string> htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateMultiPagePdf(std::vector<std::string> htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateMultiPagePdf(std::shared_ptr<const std::vector<std::string>> htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateToBuffer(std::string htmlContent, std::string& outputBuffer);
+    bool generatePreview(std::string htmlContent, std::string& image, const ImageConfig& config = ImageConfig());
+    // Any request, e.g. one with a PdfJobControl; gives up waiting at its deadline
+    PdfGenerateResult execute(PdfGenerateRequest request);
+
+    // Non-blocking: queue the request and return at once. The callback runs on the
+    // converter thread; false if the converter is stopping, in which case the
+    // request is dropped and the callback never runs. The future overload reports
+    // that as a failed result instead.
+    std::future<PdfGenerateResult> generateAsync(PdfGenerateRequest request);
+    bool generateAsync(PdfGenerateRequest request, CompletionCallback callback);
+
+    // Requests queued and not yet started
+    size_t pending() const { return pending_.load(); }
+
+private:
+    // Queue link; the queue's stub is a bare Node
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+    };
+    struct Job : Node {
+        PdfGenerateRequest request;
+        CompletionCallback callback;
+        std::chrono::steady_clock::time_point postedAt;
+    };
+
+    PdfConfig config_;
+    std::shared_ptr<PdfCache> cache_;
+
+    // Intrusive MPSC queue (Vyukov): producers swap themselves in at head_,
+    // the converter thread alone follows next links from tail_
+    std::atomic<Node*> head_;
+    Node* tail_;
+    Node stub_;
+    std::atomic<size_t> pending_{0};
+
+    // Parking for the converter thread while the queue is empty
+    std::mutex parkMutex_;
+    std::condition_variable wakeup_;
+    std::atomic<bool> parked_{false};
+    std::atomic<bool> stopping_{false};
+
+    std::thread thread_;
+
+    void push(Node* node);
+    Job* pop();
+    void run();
+};
+
+} // namespace htmlToPDF
+
+using PdfConverterThread = htmlToPDF::PdfConverterThread;
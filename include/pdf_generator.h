@@ -1,23 +1,141 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <future>
+#include <memory>
+#include "pdf_cache.h"
+
+// PdfGeneratorProxy needs wxWidgets; without it (HTMLTOPDF_WITH_WX=0) use PdfConverterThread
+#ifndef HTMLTOPDF_WITH_WX
+#define HTMLTOPDF_WITH_WX 1
+#endif
+#if HTMLTOPDF_WITH_WX
 #include <wx/event.h>
 #include <wx/thread.h>
 #include "pdfevent.h"
+#endif
+
+struct wkhtmltopdf_converter;
 
 namespace htmlToPDF {
 
+struct PdfGenerateRequest;
+struct PdfGenerateResult;
+
+// How wkhtmltopdf trades conversion time against output size and fidelity;
+// bench/render_profile_bench measures each one on the built-in templates.
+// Fast and Balanced turn JavaScript off, which also drops wkhtmltopdf's 200 ms
+// wait for scripts; the built-in templates render the same without it.
+enum class RenderProfile : uint8_t {
+    Default,   // wkhtmltopdf's own defaults, as before profiles existed
+    Fast,      // no JavaScript or outline, images at 96 dpi / quality 60
+    Balanced,  // no JavaScript or outline, images at 150 dpi / quality 85
+    Quality    // with outline, images at 300 dpi / quality 94; JavaScript on for custom templates
+};
+
+const char* renderProfileName(RenderProfile profile);
+
 struct PdfConfig {
     std::string pageSize = "A4";
     std::string marginTop = "20mm";
     std::string marginBottom = "20mm";
     std::string marginLeft = "15mm";
     std::string marginRight = "15mm";
-    bool enableLocalFileAccess = true;  // needed for local images
+    bool enableLocalFileAccess = false;  // only for HTML that references local files; inline images with AssetCache
+    RenderProfile profile = RenderProfile::Default;
+};
+
+// Preview images rendered by ImageGenerator
+struct ImageConfig {
+    std::string format = "png";    // "png" or "jpg"
+    int dpi = 48;                  // 96 draws one CSS pixel per image pixel
+    int quality = 70;              // JPEG quality, 1-100
+    int page = 1;                  // page to render, counted from 1; 0 renders the whole document
+    std::string pageSize = "A4";   // paper the page is cut from: A3, A4, A5, Letter or Legal
+    bool landscape = false;
+    bool enableLocalFileAccess = false;
+};
+
+// Where a running conversion is, as reported by wkhtmltopdf
+struct PdfProgress {
+    int phase = 0;
+    int phaseCount = 0;
+    std::string phaseDescription;  // "Loading pages", "Printing pages", ...
+    int percent = 0;               // within the current phase
+};
+
+// Shared between a caller and its queued or running conversion
+class PdfCancelToken {
+public:
+    void cancel() { cancelled_ = true; }
+    bool cancelled() const { return cancelled_.load(); }
+
+private:
+    std::atomic<bool> cancelled_{false};
+};
+
+// Per-request progress reporting, deadline and cancellation.
+// wkhtmltopdf cannot be interrupted inside a process: with PdfGenerator and
+// PdfGeneratorProxy a job that expires or is cancelled stops waiting for the
+// conversion lock, and one already converting is reported as failed when
+// wkhtmltopdf returns. PdfWorkerPool kills the worker process instead, so a
+// hung page releases its slot at the deadline.
+struct PdfJobControl {
+    std::function<void(const PdfProgress&)> onProgress;  // runs on the converting thread
+    std::chrono::milliseconds timeout{0};                 // 0 = no deadline
+    std::shared_ptr<PdfCancelToken> cancelToken;
+    std::chrono::steady_clock::time_point deadline{};     // set from timeout when submitted
+    std::string templateName;                             // metrics tag, e.g. "invoice"
+
+    // Start the timeout clock unless it is already running
+    void arm();
+    bool expired() const;
+    bool cancelled() const { return cancelToken && cancelToken->cancelled(); }
+};
+
+// A converted PDF read in place from wkhtmltopdf's own buffer. Holds the
+// converter (and its output) alive until destroyed or reset(); move-only.
+//
+// Releasing it destroys the converter, a Qt object tree, under the conversion
+// lock. So release it on the thread that converted it, and never from inside
+// a progress or completion callback: those run under that lock, which is not
+// recursive, and would deadlock. To hand the PDF to another thread, copy it
+// out (std::string(output.view())) and release the PdfOutput here.
+class PdfOutput {
+public:
+    PdfOutput() = default;
+    PdfOutput(PdfOutput&& other) noexcept;
+    PdfOutput& operator=(PdfOutput&& other) noexcept;
+    PdfOutput(const PdfOutput&) = delete;
+    PdfOutput& operator=(const PdfOutput&) = delete;
+    ~PdfOutput();
+
+    explicit operator bool() const { return converter_ != nullptr || cached_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+    // Release the converter now instead of at destruction
+    void reset();
+
+private:
+    friend class PdfGenerator;
+    friend class ImageGenerator;
+    explicit PdfOutput(wkhtmltopdf_converter* converter);
+    explicit PdfOutput(PdfCache::Bytes cached);
+
+    wkhtmltopdf_converter* converter_ = nullptr;
+    PdfCache::Bytes cached_;  // set instead of converter_ when served from a PdfCache
+    const char* data_ = nullptr;
+    size_t size_ = 0;
 };
 
 // Thread-safe PDF generator (serializes all conversions via mutex)
@@ -31,12 +149,40 @@ public:
         int marginBottom = 10;
         int marginLeft = 10;
         int marginRight = 10;
+        bool enableLocalFileAccess = false;  // as PdfConfig::enableLocalFileAccess
+        int pageOffset = 0;                 // added to [page]; continues numbering across separately converted parts
+        std::string footerRight = "Page [page] of [toPage]";
+        RenderProfile profile = RenderProfile::Default;
     };
 
     PdfGenerator();
     explicit PdfGenerator(const PdfConfig& config);
     ~PdfGenerator();
     
+    // Serve repeated conversions from cache (nullptr disables). Set before use; not synchronized.
+    void setCache(std::shared_ptr<PdfCache> cache) { cache_ = std::move(cache); }
+    const std::shared_ptr<PdfCache>& cache() const { return cache_; }
+
+    // Cache keys: everything that determines the PDF for the config-based calls
+    // (generate, generateToBuffer, generateToOutput) and the settings-based ones
+    static PdfCache::Key cacheKey(const std::vector<std::string_view>& pages, const PdfConfig& config);
+    static PdfCache::Key cacheKey(const std::vector<std::string_view>& pages, const PdfSettings& settings);
+
+    // Progress, deadline and cancellation for this generator's conversions
+    void setJobControl(PdfJobControl control) { control_ = std::move(control); }
+    const PdfJobControl& jobControl() const { return control_; }
+
+    // Jobs abandoned process-wide for missing their deadline or being cancelled
+    static size_t timeoutCount() { return timeouts_.load(); }
+    static size_t cancelCount() { return cancellations_.load(); }
+    // Short name for a document in log messages: its <title>, or its size
+    static std::string documentLabel(const std::string& htmlContent);
+
+    // Run a queued request on the calling thread with its job control: the
+    // dispatch behind PdfGeneratorProxy and PdfConverterThread. Buffer and
+    // preview results are returned in pdfData; exceptions become failures.
+    PdfGenerateResult execute(const PdfGenerateRequest& request);
+
     // Initialize/deinitialize the library (call once at app start/end)
     static bool initLibrary();
     static void deinitLibrary();
@@ -55,14 +201,49 @@ public:
     
     // Generate PDF to memory buffer
     bool generateToBuffer(const std::string& htmlContent, std::string& outputBuffer);
+
+    // Generate PDF and hand out wkhtmltopdf's buffer without copying it; empty on
+    // failure. Release the result on this thread (see PdfOutput).
+    PdfOutput generateToOutput(const std::string& htmlContent);
+
+    // Receives the PDF in chunks; return false to stop early
+    using ChunkSink = std::function<bool(const char* data, size_t size)>;
+
+    // Generate PDF and stream it to sink in chunks of at most chunkSize bytes.
+    // The sink runs after the conversion lock is released, so a slow client
+    // does not hold up other conversions.
+    bool generateToSink(const std::string& htmlContent, const ChunkSink& sink, size_t chunkSize = 64 * 1024);
+
+    // Generate PDF and write it to an open file descriptor (socket, pipe, file)
+    bool generateToFd(const std::string& htmlContent, int fd);
     
 private:
+    friend class PdfOutput;
+    friend class ImageGenerator;  // shares the lock and job handling
+
     PdfConfig config_;
+    PdfJobControl control_;
+    std::shared_ptr<PdfCache> cache_;
     static bool initialized_;
-    static std::mutex mutex_;  // Serializes all PDF generation (wkhtmltopdf is not thread-safe)
+    static std::timed_mutex mutex_;  // Serializes all PDF generation (wkhtmltopdf is not thread-safe)
+    static std::atomic<size_t> timeouts_;
+    static std::atomic<size_t> cancellations_;
+    
+    // Lock mutex_ unless the job expires or is cancelled while waiting
+    static bool lockForJob(std::unique_lock<std::timed_mutex>& lock, const PdfJobControl& job, const std::string& htmlContent,
+                           size_t documentBytes);
+    // wkhtmltopdf_convert with progress reporting; false if it failed or the job was abandoned meanwhile
+    static bool convertForJob(wkhtmltopdf_converter* converter, const PdfJobControl& job, const std::string& htmlContent,
+                              size_t documentBytes);
+    // Count and log a job given up on; true if it was
+    static bool abandonJob(const PdfJobControl& job, const char* stage, const std::string& htmlContent, size_t documentBytes);
     
     bool doConvert(const std::string& htmlContent, const std::string& outputPath, std::string* outputBuffer = nullptr);
+    // Convert with config_; on success the caller owns the converter. mutex_ must be held.
+    wkhtmltopdf_converter* runConversion(const std::string& htmlContent, const std::string& outputPath, const PdfJobControl& job);
+    static void destroyConverter(wkhtmltopdf_converter* converter);
     bool doConvertWithSettings(const std::string& htmlContent, const std::string& outputPath, const PdfSettings& settings);
+    bool doConvertMultiPage(const std::vector<std::string>& htmlPages, const std::string& outputPath, const PdfSettings& settings);
 };
 
 // Request data structure for PDF generation
@@ -70,7 +251,8 @@ struct PdfGenerateRequest {
     enum class RequestType {
         GenerateFromHtml,
         GenerateMultiPage,
-        GenerateToBuffer
+        GenerateToBuffer,
+        GeneratePreview   // image of one page into outputBuffer / pdfData, see ImageGenerator
     };
     
     RequestType type = RequestType::GenerateFromHtml;
@@ -78,15 +260,29 @@ struct PdfGenerateRequest {
     std::vector<std::string> htmlPages;  // for multi-page
     std::string outputPath;
     PdfGenerator::PdfSettings settings;
-    std::string* outputBuffer = nullptr;  // for generateToBuffer
+    ImageConfig imageConfig;              // for GeneratePreview
+    std::string* outputBuffer = nullptr;  // for generateToBuffer (synchronous calls only)
+    PdfJobControl control;  // progress, deadline and cancellation
+
+    // Set instead of htmlContent/htmlPages to convert a buffer the caller shares without copying it
+    std::shared_ptr<const std::string> sharedHtml;
+    std::shared_ptr<const std::vector<std::string>> sharedPages;
+
+    const std::string& html() const { return sharedHtml ? *sharedHtml : htmlContent; }
+    const std::vector<std::string>& pages() const { return sharedPages ? *sharedPages : htmlPages; }
 };
 
 // Result data structure
 struct PdfGenerateResult {
     bool success = false;
     std::string errorMessage;
+    std::string pdfData;  // PDF (or preview image) bytes for buffer requests made through a proxy or converter thread
+    bool timedOut = false;
+    bool cancelled = false;
 };
 
+#if HTMLTOPDF_WITH_WX
+
 // ============================================================================
 // PdfGeneratorProxy - call from worker threads, executes on main thread
 // ============================================================================
@@ -98,11 +294,37 @@ public:
     
     // Set the event handler (usually wxTheApp or main frame) - must be called before use
     static void SetEventHandler(wxEvtHandler* handler);
+    // Cache used by the main-thread generator; set before the first request
+    static void SetCache(std::shared_ptr<PdfCache> cache);
     
-    // Thread-safe methods that dispatch to main thread and wait for completion
+    // Thread-safe methods that dispatch to main thread and wait for completion.
+    // The const& overloads copy the HTML once; the rvalue and shared_ptr overloads
+    // move or share it all the way to wkhtmltopdf.
     bool generateFromHtml(const std::string& htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateFromHtml(std::string&& htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateFromHtml(std::shared_ptr<const std::string> htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
     bool generateMultiPagePdf(const std::vector<std::string>& htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateMultiPagePdf(std::vector<std::string>&& htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateMultiPagePdf(std::shared_ptr<const std::vector<std::string>> htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
     bool generateToBuffer(const std::string& htmlContent, std::string& outputBuffer);
+    bool generateToBuffer(std::string&& htmlContent, std::string& outputBuffer);
+    // Preview image of one page, see ImageGenerator
+    bool generatePreview(std::string htmlContent, std::string& image, const ImageConfig& config = ImageConfig());
+    // Any request, e.g. one with a PdfJobControl; waits like the methods above
+    PdfGenerateResult execute(PdfGenerateRequest request);
+
+    // Non-blocking variants: queue the request to the main thread and return at once,
+    // so the caller can render the next document while this one converts.
+    // GenerateToBuffer results carry the PDF in PdfGenerateResult::pdfData.
+    // A future is abandoned (never made ready) if the app shuts down first; wait with a timeout.
+    using CompletionCallback = std::function<void(PdfGenerateResult&&)>;
+    std::future<PdfGenerateResult> generateAsync(PdfGenerateRequest request);
+    // The callback runs on the main thread
+    void generateAsync(PdfGenerateRequest request, CompletionCallback callback);
+
+    std::future<PdfGenerateResult> generateFromHtmlAsync(std::string htmlContent, std::string outputPath, const PdfGenerator::PdfSettings& settings);
+    std::future<PdfGenerateResult> generateMultiPagePdfAsync(std::vector<std::string> htmlPages, std::string outputPath, const PdfGenerator::PdfSettings& settings);
+    std::future<PdfGenerateResult> generateToBufferAsync(std::string htmlContent);
 
     // Handler to be called on main thread (register this with your event handler)
     static void OnEvent(wxCommandEvent& event);
@@ -113,12 +335,20 @@ private:
     static PdfGenerator generator_;  // The actual generator, used only on main thread
     
     // Execute request on main thread and wait for completion
-    PdfGenerateResult executeOnMainThread(const PdfGenerateRequest& request);
+    PdfGenerateResult executeOnMainThread(PdfGenerateRequest&& request);
+    // Queue request to the main thread; callback receives the result there
+    static void postToMainThread(PdfGenerateRequest&& request, CompletionCallback&& callback);
 };
 
+#endif // HTMLTOPDF_WITH_WX
+
 } // namespace htmlToPDF
 
 // For backward compatibility
 using PdfGenerator = htmlToPDF::PdfGenerator;
 using PdfConfig = htmlToPDF::PdfConfig;
+using RenderProfile = htmlToPDF::RenderProfile;
+using ImageConfig = htmlToPDF::ImageConfig;
+#if HTMLTOPDF_WITH_WX
 using PdfGeneratorProxy = htmlToPDF::PdfGeneratorProxy;
+#endif
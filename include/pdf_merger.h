@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace htmlToPDF {
+
+// Joins PDFs written by wkhtmltopdf into one document, streaming each part to
+// the output as it is appended, so only one part is ever held in memory.
+//
+// Every object of a part is copied with its object numbers shifted past the
+// parts before it; stream data is copied untouched. The part's page tree is
+// hung under a new root, so inherited page attributes are kept. Document
+// outlines of the parts are not carried over. Handles classic cross-reference
+// tables (what Qt writes); xref streams and incremental updates are rejected.
+class PdfMerger {
+public:
+    explicit PdfMerger(const std::string& outputPath);
+
+    PdfMerger(const PdfMerger&) = delete;
+    PdfMerger& operator=(const PdfMerger&) = delete;
+
+    // Add the pages of pdf after those appended so far; false if it cannot be parsed
+    bool append(std::string_view pdf);
+    bool appendFile(const std::string& path);
+
+    // Write the page tree root, catalog and cross-reference table; the output is
+    // not a valid PDF until this succeeds
+    bool finish();
+
+    int pageCount() const { return pageCount_; }
+
+private:
+    std::string path_;
+    std::ofstream out_;
+    uint64_t written_ = 0;
+    std::vector<uint64_t> offsets_;   // by object number; 0 for unused numbers
+    std::vector<uint32_t> pageTrees_; // root page tree node of each part
+    uint32_t infoObject_ = 0;         // document info of the first part
+    int pageCount_ = 0;
+    bool failed_ = false;
+
+    void write(std::string_view data);
+};
+
+} // namespace htmlToPDF
+
+using PdfMerger = htmlToPDF::PdfMerger;
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace htmlToPDF {
+
+// Latencies in microseconds, bucketed log-linearly like an HDR histogram:
+// 16 buckets per power of two, so any quantile is within about 6% of the
+// recorded value. Recording is lock-free.
+class LatencyHistogram {
+public:
+    void record(uint64_t micros);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sumMicros() const { return sum_.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding quantile q (0..1), in microseconds (within ~6%)
+    uint64_t quantile(double q) const;
+
+private:
+    static constexpr int subBuckets = 16;
+    static constexpr int bucketCount = 40 * subBuckets;  // up to ~2^40 us, about 12 days
+
+    static int bucketOf(uint64_t micros);
+    static uint64_t upperBound(int bucket);
+
+    std::array<std::atomic<uint64_t>, bucketCount> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+// Where a document spends its time, per pipeline stage, tagged by template
+// name and document size class. Off by default; while disabled every timing
+// point costs one relaxed atomic load. Export with prometheusText() for a
+// scrape handler, or writePrometheusFile() for node_exporter's textfile
+// collector. Thread-safe.
+class PdfMetrics {
+public:
+    enum class Stage {
+        BuildContext,   // builder buildContext()
+        Render,         // TemplateEngine render
+        QueueWait,      // waiting for the proxy's main thread or a pool worker
+        LockWait,       // waiting for the process-wide wkhtmltopdf lock
+        Convert,        // wkhtmltopdf_convert as a whole
+        ConvertPhase,   // each wkhtmltopdf phase, labelled with its description
+        OutputWrite,    // copying or writing the finished PDF
+        Count
+    };
+
+    enum class Outcome { Succeeded, Failed, TimedOut, Cancelled, Count };
+
+    static PdfMetrics& shared();
+
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    void record(Stage stage, std::string_view templateName, size_t documentBytes,
+                std::chrono::steady_clock::duration elapsed, std::string_view phase = {});
+    void countDocument(Outcome outcome, std::string_view templateName, size_t documentBytes);
+
+    // Prometheus text exposition format (version 0.0.4)
+    std::string prometheusText() const;
+    // Written beside path and renamed over it, so readers never see half a file
+    bool writePrometheusFile(const std::string& path) const;
+
+    void reset();
+
+    // "lt16k", "lt256k", "lt4m" or "ge4m"
+    static const char* sizeClass(size_t documentBytes);
+
+    // Times a scope; records nothing if metrics were disabled when it started
+    class Timer {
+    public:
+        Timer(Stage stage, std::string_view templateName, size_t documentBytes = 0);
+        ~Timer();
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        // Size known only once the stage has produced the document
+        void setDocumentBytes(size_t documentBytes) { documentBytes_ = documentBytes; }
+
+    private:
+        Stage stage_;
+        std::string_view templateName_;
+        size_t documentBytes_;
+        bool running_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+private:
+    // Series key: stage, template, size class, phase
+    using SeriesKey = std::string;
+
+    static std::atomic<bool> enabled_;
+
+    mutable std::mutex mutex_;
+    std::map<SeriesKey, std::shared_ptr<LatencyHistogram>> latencies_;
+    std::map<SeriesKey, uint64_t> documents_;
+};
+
+} // namespace htmlToPDF
+
+using PdfMetrics = htmlToPDF::PdfMetrics;
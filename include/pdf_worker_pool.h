@@ -0,0 +1,103 @@
+#pragma once
+
+#include "pdf_generator.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace htmlToPDF {
+
+// ============================================================================
+// PdfWorkerPool - converts on N child processes, one wkhtmltopdf per process
+// ============================================================================
+//
+// libwkhtmltox has one global init and is not thread-safe, so PdfGenerator
+// converts one document at a time per process. The pool starts worker
+// processes (by default this same executable with --pdf-worker), each with its
+// own wkhtmltopdf_init, and sends them requests over a pipe. Conversions run
+// in parallel up to the number of workers. A worker that crashes fails only
+// the request it was converting and is started again for the next one.
+//
+// The host application must hand the worker command line to runWorker()
+// before creating any windows or threads:
+//
+//     int main(int argc, char* argv[]) {
+//         if (PdfWorkerPool::isWorkerCommandLine(argc, argv)) return PdfWorkerPool::runWorker();
+//         ...
+//     }
+//
+// Thread-safe: call from any number of threads.
+class PdfWorkerPool {
+public:
+    static constexpr const char* workerArgument = "--pdf-worker";
+
+    // workers == 0 uses one per hardware thread. An empty executable means
+    // this process's own executable.
+    explicit PdfWorkerPool(unsigned workers = 0, const std::string& executable = "");
+    ~PdfWorkerPool();
+
+    PdfWorkerPool(const PdfWorkerPool&) = delete;
+    PdfWorkerPool& operator=(const PdfWorkerPool&) = delete;
+
+    // Same contracts as the PdfGenerator methods of the same name
+    bool generateFromHtml(const std::string& htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateMultiPagePdf(const std::vector<std::string>& htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings);
+    bool generateToBuffer(const std::string& htmlContent, std::string& outputBuffer, const PdfConfig& config = PdfConfig());
+    bool generatePreview(const std::string& htmlContent, std::string& image, const ImageConfig& config = ImageConfig());
+
+    // Run one request on the next free worker, blocking until it finishes.
+    // GenerateToBuffer and GeneratePreview requests write into *request.outputBuffer. A request
+    // past its deadline or cancelled (request.control) kills its worker, which
+    // is started again for the next request; progress is reported on this thread.
+    PdfGenerateResult execute(const PdfGenerateRequest& request, const PdfConfig& config = PdfConfig());
+
+    // Answer repeated requests from cache without dispatching them (nullptr disables).
+    // Set before use; not synchronized.
+    void setCache(std::shared_ptr<PdfCache> cache) { cache_ = std::move(cache); }
+
+    // Restart a worker after this many conversions to bound WebKit's memory
+    // growth (0 = never)
+    void setMaxJobsPerWorker(size_t jobs);
+
+    size_t workerCount() const { return workers_.size(); }
+    // Workers started again after exiting unexpectedly
+    size_t restartCount() const { return restarts_.load(); }
+    // Requests abandoned for missing their deadline or being cancelled
+    size_t timeoutCount() const { return timeouts_.load(); }
+    size_t cancelCount() const { return cancellations_.load(); }
+
+    // True when argv asks this process to be a worker
+    static bool isWorkerCommandLine(int argc, char* argv[]);
+    // Serve requests on stdin/stdout until the pool closes the pipe; returns the exit code
+    static int runWorker();
+
+private:
+    struct Worker;
+
+    // Next idle worker, or nullptr if the job expires or is cancelled first
+    Worker* acquire(const PdfJobControl& job);
+    void release(Worker* worker);
+    bool start(Worker& worker);
+    void stop(Worker& worker, bool force = false);
+    // Count and log a request given up on, and build its result
+    PdfGenerateResult abandon(const PdfJobControl& job, const char* stage, const PdfGenerateRequest& request);
+
+    std::string executable_;
+    std::shared_ptr<PdfCache> cache_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<Worker*> idle_;
+    std::mutex mutex_;
+    std::condition_variable available_;
+    std::atomic<size_t> maxJobsPerWorker_{0};
+    std::atomic<size_t> restarts_{0};
+    std::atomic<size_t> timeouts_{0};
+    std::atomic<size_t> cancellations_{0};
+};
+
+} // namespace htmlToPDF
+
+using PdfWorkerPool = htmlToPDF::PdfWorkerPool;
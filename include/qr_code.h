@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// QR code symbols (ISO/IEC 18004, versions 1-40) encoded natively, for the
+// e-invoice validation link. The whole text goes in one segment: numeric or
+// alphanumeric mode when every character allows it, bytes (UTF-8) otherwise.
+// The smallest version that fits is used, with the mask of lowest penalty.
+class QrCode {
+public:
+    enum class Ecc { Low, Medium, Quartile, High };
+
+    // Symbol for text; size() is 0 if the text does not fit version 40
+    static QrCode encode(std::string_view text, Ecc ecc = Ecc::Medium);
+
+    int size() const { return size_; }
+    int version() const { return version_; }
+    int mask() const { return mask_; }
+    bool dark(int x, int y) const { return modules_[static_cast<size_t>(y) * size_ + x] != 0; }
+
+    // Inline SVG drawing the dark modules as one path, with border light modules
+    // around them. Scales to its container through the viewBox.
+    std::string toSvg(int border = 1) const;
+
+    // toSvg() of encode(text, ecc), encoded once per text and reused; nullptr if too long
+    static std::shared_ptr<const std::string> svg(std::string_view text, Ecc ecc = Ecc::Medium);
+
+private:
+    QrCode() = default;
+
+    void set(int x, int y, bool dark, bool function = false);
+    void drawFunctionPatterns();
+    void drawFinder(int cx, int cy);
+    void drawAlignment(int cx, int cy);
+    void drawFormatBits(int mask);
+    void drawVersion();
+    void placeCodewords(const std::vector<uint8_t>& codewords);
+    void applyMask(int mask);
+    long penalty() const;
+
+    int version_ = 0;
+    int size_ = 0;
+    int mask_ = 0;
+    Ecc ecc_ = Ecc::Medium;
+    std::vector<uint8_t> modules_;
+    std::vector<uint8_t> function_;  // modules the data and masks must not touch
+};
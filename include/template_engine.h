@@ -1,26 +1,323 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <string_view>
 #include <vector>
+#include <utility>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <type_traits>
+#include <fmt/format.h>
 
-// Represents a single item (e.g., invoice line item)
+// Interned variable/list name. Equal names share one slot for the whole process,
+// so a name resolved once (e.g. when a template is compiled) becomes an array index.
+struct TemplateKey {
+    static constexpr uint32_t invalid = UINT32_MAX;
+
+    uint32_t slot = invalid;
+
+    TemplateKey() = default;
+    explicit TemplateKey(std::string_view name);
+    static TemplateKey fromSlot(uint32_t slot) { TemplateKey key; key.slot = slot; return key; }
+
+    bool valid() const { return slot != invalid; }
+    std::string_view name() const;
+};
+
+// Process-wide, thread-safe name <-> slot table behind TemplateKey
+class TemplateKeyRegistry {
+public:
+    static uint32_t intern(std::string_view name);
+    static uint32_t find(std::string_view name);  // TemplateKey::invalid if never interned
+    static std::string_view name(uint32_t slot);
+    static size_t size();
+};
+
+// Map from interned key to value. Values live in a compact vector; once a map
+// holds more than a handful of entries a slot-indexed table points into it, so
+// lookups by TemplateKey are two array reads. Small maps (list items with a few
+// fields) skip the table and scan their entries instead.
+template <typename T>
+class TemplateKeyMap {
+public:
+    struct Entry {
+        uint32_t slot;
+        T value;
+        std::string_view key() const { return TemplateKeyRegistry::name(slot); }
+    };
+
+    TemplateKeyMap() = default;
+    TemplateKeyMap(std::initializer_list<std::pair<std::string_view, T>> init) {
+        for (const auto& [key, value] : init) (*this)[key] = value;
+    }
+
+    T& operator[](TemplateKey key) {
+        if (index_.empty()) {
+            for (auto& entry : entries_) {
+                if (entry.slot == key.slot) return entry.value;
+            }
+            entries_.push_back(Entry{key.slot, T()});
+            if (entries_.size() > kLinearScanLimit) buildIndex();
+            return entries_.back().value;
+        }
+        if (key.slot >= index_.size()) index_.resize(key.slot + 1, 0);
+        uint32_t& pos = index_[key.slot];
+        if (pos == 0) {
+            entries_.push_back(Entry{key.slot, T()});
+            pos = static_cast<uint32_t>(entries_.size());
+        }
+        return entries_[pos - 1].value;
+    }
+    T& operator[](std::string_view key) { return (*this)[TemplateKey(key)]; }
+
+    const T* find(TemplateKey key) const {
+        if (index_.empty()) {
+            for (const auto& entry : entries_) {
+                if (entry.slot == key.slot) return &entry.value;
+            }
+            return nullptr;
+        }
+        if (key.slot >= index_.size() || index_[key.slot] == 0) return nullptr;
+        return &entries_[index_[key.slot] - 1].value;
+    }
+    const T* find(std::string_view key) const {
+        uint32_t slot = TemplateKeyRegistry::find(key);
+        return slot == TemplateKey::invalid ? nullptr : find(TemplateKey::fromSlot(slot));
+    }
+    size_t count(std::string_view key) const { return find(key) ? 1 : 0; }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    void reserve(size_t n) { entries_.reserve(n); }
+    void clear() { index_.clear(); entries_.clear(); }
+
+    typename std::vector<Entry>::const_iterator begin() const { return entries_.begin(); }
+    typename std::vector<Entry>::const_iterator end() const { return entries_.end(); }
+
+private:
+    static constexpr size_t kLinearScanLimit = 8;
+
+    void buildIndex() {
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            uint32_t slot = entries_[i].slot;
+            if (slot >= index_.size()) index_.resize(slot + 1, 0);
+            index_[slot] = static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    std::vector<uint32_t> index_;   // slot -> position in entries_ + 1, 0 = absent
+    std::vector<Entry> entries_;
+};
+
+// A context value. Text is stored as given; numbers and flags keep their type and
+// are formatted only when a substitution emits them, so a value hidden by an
+// {{#if}} costs no formatting. Flags render as "1" / "" and test like the strings
+// they replace.
+class TemplateValue {
+public:
+    enum class Type : uint8_t { String, Number, Quantity, Integer, Bool };
+
+    // Scratch space for format(); fits any double at up to 9 decimals with separators
+    using FormatBuffer = char[512];
+
+    TemplateValue() = default;
+    TemplateValue(std::string text) : text_(std::move(text)) {}
+    TemplateValue(const char* text) : text_(text) {}
+    TemplateValue(std::string_view text) : text_(text) {}
+    TemplateValue(bool flag) : type_(Type::Bool) { integer_ = flag ? 1 : 0; }
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+                                                      !std::is_same_v<T, char>>>
+    TemplateValue(T value) : type_(Type::Integer) { integer_ = static_cast<long long>(value); }
+    // Say how a double should look: number() or quantity()
+    TemplateValue(double) = delete;
+
+    // 1,234.50 - fixed decimals with thousand separators
+    static TemplateValue number(double value, int decimals = 2);
+    // 12.5, 3 - two decimals at most, trailing zeros dropped
+    static TemplateValue quantity(double value);
+
+    Type type() const { return type_; }
+    bool isString() const { return type_ == Type::String; }
+    const std::string& text() const { return text_; }  // String values only
+
+    // Text as it appears in output; non-string values are written into buffer
+    std::string_view format(FormatBuffer& buffer) const;
+    std::string str() const;
+
+    // Condition truth: not empty, "0" or "false" once formatted
+    bool truthy() const;
+
+    bool operator==(const TemplateValue& other) const;
+    bool operator!=(const TemplateValue& other) const { return !(*this == other); }
+
+private:
+    Type type_ = Type::String;
+    int8_t decimals_ = 0;
+    union {
+        double number_;
+        long long integer_ = 0;
+    };
+    std::string text_;
+};
+
+struct Item;
+using TemplateVariables = TemplateKeyMap<TemplateValue>;
+using TemplateLists = TemplateKeyMap<std::vector<Item>>;
+
+// Represents a single item (e.g., invoice line item). Names not found in the
+// item resolve against the enclosing items and then TemplateContext::variables,
+// so document-wide flags need not be copied into every item.
 struct Item {
-    std::map<std::string, std::string> fields;
+    TemplateVariables fields;
+    TemplateLists lists{};  // Child arrays for {{#each}} nested inside this item's block
 };
 
 // Context for template rendering
 struct TemplateContext {
-    std::map<std::string, std::string> variables;      // Simple key-value pairs
-    std::map<std::string, std::vector<Item>> lists;    // Arrays for {{#each}}
+    TemplateVariables variables;    // Simple key-value pairs
+    TemplateLists lists;            // Arrays for {{#each}}
+};
+
+// One instruction of a template tokenized at build time by
+// cmake/generate_templates.cmake. Ops are in source order; block ops carry the
+// index of their {{else}} and closing op so the tree is built without scanning text.
+struct TemplateOp {
+    enum Code : uint8_t { Text, Variable, RawVariable, If, Else, Each, End };
+
+    Code code;
+    uint32_t value;    // Text: source offset, Variable/If/Each: index into the key table
+    uint32_t length;   // Text: byte count
+    uint32_t elseOp;   // If: index of its Else op, 0 if none
+    uint32_t endOp;    // If/Each: index of the matching End op
+};
+
+// Generated, pre-tokenized form of a built-in template
+struct TemplateTable {
+    const char* source;
+    size_t length;             // source length at generation time
+    const TemplateOp* ops;
+    size_t opCount;            // 0 if the template could not be tokenized at build time
+    const char* const* keys;
+    size_t keyCount;
+};
+
+class CompiledTemplate;
+
+// Remembers rendered fragments of one template between renders. A fragment is
+// reused when every variable it reads has the same value as last time, so pages
+// of one document re-render only what differs (items, page number). Not
+// thread-safe: use one cache per document or per thread.
+class TemplateFragmentCache {
+public:
+    // Values of a fragment's dependencies, nullptr for a missing variable
+    using Values = std::vector<const TemplateValue*>;
+
+    // Output stored for the fragment if it was rendered from equal values
+    const std::string* find(const CompiledTemplate& owner, uint32_t fragment, const Values& values);
+    void store(const CompiledTemplate& owner, uint32_t fragment, const Values& values, std::string output);
+
+    void clear();
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct Entry {
+        bool filled = false;
+        std::vector<TemplateValue> values;
+        std::vector<bool> present;
+        std::string output;
+    };
+
+    void bind(const CompiledTemplate& owner);
+
+    const CompiledTemplate* owner_ = nullptr;
+    std::vector<Entry> entries_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+// A template parsed once into a tree of text, variable, {{#if}}/{{else}} and
+// {{#each}} nodes. Create with TemplateEngine::compile() and render as often as
+// needed; rendering walks the tree once, so cost grows with output size only.
+// {{key}} substitutions are HTML-escaped, {{{key}}} ones are written as is.
+class CompiledTemplate {
+public:
+    struct Node {
+        enum class Type { Text, Variable, If, Each, Fragment };
+
+        Type type = Type::Text;
+        size_t offset = 0;                // Text: span within source()
+        size_t length = 0;
+        std::string name;                 // Variable/If: key, Each: list name
+        TemplateKey key;                  // name, interned at compile time
+        bool raw = false;                 // Variable written as {{{key}}}: not HTML-escaped
+        std::vector<Node> children;       // If: true branch, Each: loop body, Fragment: content
+        std::vector<Node> elseChildren;   // If: {{else}} branch
+        uint32_t fragment = 0;            // Fragment: index into TemplateFragmentCache
+        std::vector<TemplateKey> deps;    // Fragment: every key read by its content
+    };
+
+    // Receives rendered output in order; called with chunks of up to a few KB
+    using Writer = std::function<void(const char* data, size_t size)>;
+
+    CompiledTemplate() = default;
+
+    // Render with the given context. Inside {{#each}} a key or list name is looked
+    // up in the current item first, then in each enclosing item, then in the context.
+    std::string render(const TemplateContext& context) const;
+
+    // Streaming variants: output is produced once, front to back, into the sink.
+    // The string and buffer overloads append to whatever is already there.
+    void render(const TemplateContext& context, std::string& out) const;
+    void render(const TemplateContext& context, fmt::memory_buffer& out) const;
+    void render(const TemplateContext& context, const Writer& writer) const;
+
+    // Render reusing fragments cached by an earlier render of this template.
+    // Fragments are the runs of static markup and {{#if}} blocks outside any
+    // {{#each}}; top-level {{key}} substitutions and loops always render live.
+    std::string render(const TemplateContext& context, TemplateFragmentCache& cache) const;
+    void render(const TemplateContext& context, std::string& out, TemplateFragmentCache& cache) const;
+
+    std::string_view source() const {
+        return staticSource_ ? std::string_view(staticSource_, staticLength_) : std::string_view(source_);
+    }
+    const std::vector<Node>& nodes() const { return nodes_; }
+    bool empty() const { return nodes_.empty(); }
+    size_t fragmentCount() const { return fragmentCount_; }
+
+private:
+    friend class TemplateEngine;
+
+    // Group cacheable runs of nodes into Fragment nodes (after parsing)
+    void markFragments();
+
+    std::string source_;                    // owned copy for runtime-compiled templates
+    const char* staticSource_ = nullptr;    // built-in templates reference the generated literal
+    size_t staticLength_ = 0;
+    std::vector<Node> nodes_;
+    uint32_t fragmentCount_ = 0;
 };
 
 class TemplateEngine {
 public:
     // Render a template string with the given context
     static std::string render(const std::string& templateStr, const TemplateContext& context);
+
+    // Parse a template string once for repeated rendering
+    static CompiledTemplate compile(const std::string& templateStr);
+
+    // Build a compiled template from a table generated at build time
+    static CompiledTemplate compile(const TemplateTable& table);
+
+    // Opt-in parallel {{#each}}: a list with at least minItems items is split into
+    // chunks rendered on a shared thread pool into separate buffers, then joined in
+    // order. 0 (the default) keeps every list single-threaded. threads = 0 uses the
+    // hardware concurrency; the pool is sized when it is first needed.
+    static void setParallelEach(size_t minItems, unsigned threads = 0);
+    static size_t parallelEachThreshold();
     
-    // Load template from file
+    // Load template from file (see TemplateRegistry to keep it compiled between documents)
     static std::string loadTemplate(const std::string& path);
     
     // Get built-in templates (HTML)
@@ -34,12 +331,14 @@ public:
     static std::string getPurchaseOrderTemplate();
     static std::string getTabularReportTemplate();
 
-private:
-    static std::string replaceVariable(const std::string& input, 
-                                        const std::string& key, 
-                                        const std::string& value);
-    static std::string processEachBlocks(const std::string& input,
-                                          const std::map<std::string, std::vector<Item>>& lists);
-    static std::string processIfBlocks(const std::string& input,
-                                         const std::map<std::string, std::string>& variables);
+    // Built-in templates, tokenized at build time and ready to render
+    static const CompiledTemplate& getCompiledInvoiceTemplate();
+    static const CompiledTemplate& getCompiledReportTemplate();
+    static const CompiledTemplate& getCompiledLetterTemplate();
+    static const CompiledTemplate& getCompiledSalesSummaryTemplate();
+    static const CompiledTemplate& getCompiledPurchaseSummaryTemplate();
+    static const CompiledTemplate& getCompiledPoisonOrderTemplate();
+    static const CompiledTemplate& getCompiledBillingStatementTemplate();
+    static const CompiledTemplate& getCompiledPurchaseOrderTemplate();
+    static const CompiledTemplate& getCompiledTabularReportTemplate();
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "template_engine.h"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiled templates loaded from disk, kept in memory and refreshed when the
+// file changes. A template is looked up by file name ("invoice.html") in the
+// outlet's override directory first, then in the search directories, and
+// finally among the built-in templates, so a file dropped into a directory
+// customizes documents without a rebuild. Files are re-checked (mtime and
+// size) at most once per check interval; in between, get() is a map lookup.
+// Thread-safe; files are read and compiled outside the lock, so a reload
+// holds up only the documents that asked for that template.
+class TemplateRegistry {
+public:
+    using TemplatePtr = std::shared_ptr<const CompiledTemplate>;
+
+    explicit TemplateRegistry(std::chrono::milliseconds checkInterval = std::chrono::milliseconds(2000));
+
+    // Directories searched in the order added
+    void addSearchDirectory(const std::string& directory);
+    // Directory whose files take precedence for one outlet
+    void setOutletDirectory(const std::string& outlet, const std::string& directory);
+    void setCheckInterval(std::chrono::milliseconds interval);
+
+    // Compiled template for name, or nullptr if no file or built-in template matches.
+    // The returned template stays valid after a reload replaces it.
+    TemplatePtr get(const std::string& name, const std::string& outlet = "");
+
+    // Forget cached lookups so the next get() checks the files again
+    void invalidate();
+
+    // Process-wide registry for callers that do not keep their own
+    static TemplateRegistry& shared();
+
+private:
+    // A template file as last read
+    struct FileEntry {
+        TemplatePtr compiled;
+        std::filesystem::file_time_type mtime;
+        uintmax_t size = 0;
+    };
+
+    // Where (outlet, name) resolved to, and when that was last checked
+    struct Lookup {
+        TemplatePtr compiled;
+        std::chrono::steady_clock::time_point checkedAt;
+    };
+
+    // Called with mutex_ held
+    std::vector<std::filesystem::path> candidatePaths(const std::string& name, const std::string& outlet) const;
+    // Called without it: they stat, read and compile files, locking only to touch files_
+    TemplatePtr resolve(const std::string& name, const std::vector<std::filesystem::path>& candidates);
+    TemplatePtr loadFile(const std::filesystem::path& path);
+
+    std::mutex mutex_;
+    std::chrono::milliseconds checkInterval_;
+    std::vector<std::string> searchDirectories_;
+    std::unordered_map<std::string, std::string> outletDirectories_;
+    std::unordered_map<std::string, FileEntry> files_;
+    std::unordered_map<std::string, Lookup> lookups_;
+    uint64_t generation_ = 0;  // bumped whenever lookups_ is cleared
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// One {{tag}} or {{{tag}}} in a template source. [begin, end) spans the
+// delimiters; the text between tags is implied by the gaps.
+struct TemplateToken {
+    size_t begin = 0;
+    size_t end = 0;
+    bool raw = false;  // triple-brace, unescaped
+
+    // Offsets of the tag body between the delimiters
+    size_t innerBegin() const { return begin + (raw ? 3 : 2); }
+    size_t innerEnd() const { return end - (raw ? 3 : 2); }
+};
+
+// Single-pass lexer for the template syntax. Every "{{" and "}}" in the source
+// is located in one sweep (16 or 32 bytes per step where the CPU allows), and
+// tags are paired from those positions instead of re-searching the string for
+// each tag. Without SIMD (Level::Scalar) tokenize() searches tag by tag with
+// std::string_view::find, which is cheaper there. Text after an unterminated
+// "{{" is left to the caller as plain text.
+class TemplateScanner {
+public:
+    enum class Level { Scalar, SSE2, AVX2 };
+
+    // Best level supported by this CPU (detected once)
+    static Level detectedLevel();
+    // Level used by tokenize(); defaults to detectedLevel(). Requests above
+    // what the CPU supports are clamped.
+    static Level level();
+    static void setLevel(Level level);
+    static const char* levelName(Level level);
+
+    // Positions of every "{{" (opens) and "}}" (closes), in ascending order.
+    // Overlapping runs report each position, so "{{{" yields two opens.
+    static void findBraces(std::string_view src, std::vector<size_t>& opens, std::vector<size_t>& closes,
+                           Level level);
+
+    static std::vector<TemplateToken> tokenize(std::string_view src) { return tokenize(src, level()); }
+    static std::vector<TemplateToken> tokenize(std::string_view src, Level level);
+};
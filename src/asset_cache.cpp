@@ -0,0 +1,200 @@
+#include "asset_cache.h"
+#include "logging.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+// Helper: media type of an image from its first bytes, falling back to the extension; nullptr if not an image
+static const char* imageMediaType(std::string_view bytes, const fs::path& path) {
+    auto startsWith = [&bytes](std::string_view prefix) { return bytes.substr(0, prefix.size()) == prefix; };
+    if (startsWith("\x89PNG\r\n\x1a\n")) return "image/png";
+    if (startsWith("\xff\xd8\xff")) return "image/jpeg";
+    if (startsWith("GIF87a") || startsWith("GIF89a")) return "image/gif";
+    if (startsWith("RIFF") && bytes.substr(8, 4) == "WEBP") return "image/webp";
+    if (startsWith("BM")) return "image/bmp";
+
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".svg") return "image/svg+xml";
+    return nullptr;
+}
+
+// Helper: append the base64 encoding of bytes to out
+static void appendBase64(std::string_view bytes, std::string& out) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t start = out.size();
+    out.resize(start + (bytes.size() + 2) / 3 * 4);
+    char* dst = &out[start];
+    const auto* src = reinterpret_cast<const unsigned char*>(bytes.data());
+    size_t whole = bytes.size() / 3 * 3;
+    for (size_t i = 0; i < whole; i += 3) {
+        uint32_t triple = (uint32_t(src[i]) << 16) | (uint32_t(src[i + 1]) << 8) | src[i + 2];
+        *dst++ = alphabet[triple >> 18];
+        *dst++ = alphabet[(triple >> 12) & 63];
+        *dst++ = alphabet[(triple >> 6) & 63];
+        *dst++ = alphabet[triple & 63];
+    }
+    size_t rest = bytes.size() - whole;
+    if (rest > 0) {
+        uint32_t triple = uint32_t(src[whole]) << 16;
+        if (rest == 2) triple |= uint32_t(src[whole + 1]) << 8;
+        *dst++ = alphabet[triple >> 18];
+        *dst++ = alphabet[(triple >> 12) & 63];
+        *dst++ = rest == 2 ? alphabet[(triple >> 6) & 63] : '=';
+        *dst++ = '=';
+    }
+}
+
+// Helper: true for values that are URLs WebKit fetches itself rather than file paths
+static bool isUrl(std::string_view value) {
+    return value.compare(0, 5, "data:") == 0 || value.compare(0, 5, "http:") == 0 || value.compare(0, 6, "https:") == 0;
+}
+
+// Helper: file path for a file:// URL, or the value itself when it is already a path.
+// file:///C:/logo.png names C:/logo.png, so the slash before a drive letter is dropped.
+static std::string filePath(const std::string& value) {
+    if (value.compare(0, 7, "file://") != 0) return value;
+    std::string path = value.substr(7);
+    if (path.compare(0, 10, "localhost/") == 0) path.erase(0, 9);
+    if (path.size() >= 3 && path[0] == '/' && std::isalpha(static_cast<unsigned char>(path[1])) && path[2] == ':')
+        path.erase(0, 1);
+    return path;
+}
+
+AssetCache::AssetCache(size_t maxBytes, std::chrono::milliseconds checkInterval)
+    : maxBytes_(maxBytes), checkInterval_(checkInterval) {
+}
+
+AssetCache& AssetCache::shared() {
+    static AssetCache cache;
+    return cache;
+}
+
+void AssetCache::setCheckInterval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkInterval_ = interval;
+}
+
+void AssetCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    bytes_ = 0;
+}
+
+AssetCache::Stats AssetCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Stats{hits_, loads_, entries_.size(), bytes_};
+}
+
+AssetCache::DataUri AssetCache::dataUri(const std::string& path) {
+    std::string key = filePath(path);
+    if (key.empty()) return nullptr;
+    auto now = std::chrono::steady_clock::now();
+
+    DataUri previous;
+    fs::file_time_type previousMtime;
+    uintmax_t previousSize = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (now - it->second.checkedAt < checkInterval_) {
+                ++hits_;
+                it->second.lastUse = ++useClock_;
+                return it->second.uri;
+            }
+            previous = it->second.uri;
+            previousMtime = it->second.mtime;
+            previousSize = it->second.size;
+        }
+    }
+
+    // The stat, read and encode run unlocked, so a cold or changed image holds up no other document
+    std::error_code ec;
+    auto mtime = fs::last_write_time(key, ec);
+    uintmax_t size = ec ? 0 : fs::file_size(key, ec);
+    bool unchanged = !ec && previous && previousMtime == mtime && previousSize == size;
+    DataUri uri = ec || unchanged ? nullptr : load(key, size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (ec) {
+        // Gone or unreadable: forget it rather than keep serving a deleted logo
+        if (it != entries_.end()) {
+            bytes_ -= it->second.uri->size();
+            entries_.erase(it);
+        }
+        return nullptr;
+    }
+    if (unchanged) {
+        ++hits_;
+        if (it != entries_.end() && it->second.uri == previous) {
+            it->second.checkedAt = now;
+            it->second.lastUse = ++useClock_;
+        }
+        return previous;
+    }
+    if (!uri) return previous;
+    ++loads_;
+    if (it != entries_.end()) bytes_ -= it->second.uri->size();
+    entries_[key] = Entry{uri, mtime, size, now, ++useClock_};
+    bytes_ += uri->size();
+    evict();
+    return uri;
+}
+
+AssetCache::DataUri AssetCache::load(const fs::path& path, uintmax_t size) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        LOG_WARN("Image {} could not be opened", path.string());
+        return nullptr;
+    }
+    std::string bytes(static_cast<size_t>(size), '\0');
+    file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    bytes.resize(static_cast<size_t>(file.gcount()));
+
+    const char* mediaType = imageMediaType(bytes, path);
+    if (mediaType == nullptr) {
+        LOG_WARN("{} is not a supported image; not inlined", path.string());
+        return nullptr;
+    }
+    auto uri = std::make_shared<std::string>("data:");
+    uri->reserve(5 + std::char_traits<char>::length(mediaType) + 8 + (bytes.size() + 2) / 3 * 4);
+    *uri += mediaType;
+    *uri += ";base64,";
+    appendBase64(bytes, *uri);
+    LOG_INFO("Image {} inlined ({} bytes)", path.string(), bytes.size());
+    return uri;
+}
+
+void AssetCache::evict() {
+    // Few distinct images are in use at once, so a scan for the oldest is cheap
+    while (bytes_ > maxBytes_ && entries_.size() > 1) {
+        auto oldest = std::min_element(entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+            return a.second.lastUse < b.second.lastUse;
+        });
+        bytes_ -= oldest->second.uri->size();
+        entries_.erase(oldest);
+    }
+}
+
+size_t AssetCache::inlineImages(TemplateContext& context, std::initializer_list<std::string_view> keys) {
+    size_t replaced = 0;
+    for (std::string_view key : keys) {
+        const TemplateValue* value = context.variables.find(key);
+        if (value == nullptr || !value->isString() || value->text().empty() || isUrl(value->text())) continue;
+        if (DataUri uri = dataUri(value->text())) {
+            context.variables[key] = *uri;
+            ++replaced;
+        } else {
+            // Not inlined, so cleared rather than left as a path: templates guard images
+            // with {{#if}}, so nothing is drawn instead of a broken image
+            context.variables[key] = "";
+        }
+    }
+    return replaced;
+}
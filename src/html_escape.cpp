@@ -0,0 +1,125 @@
+#include "html_escape.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HTML_ESCAPE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(HTML_ESCAPE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define HTML_ESCAPE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HTML_ESCAPE_TARGET(isa)
+#endif
+
+namespace {
+
+// One flag per byte value: set for & < > " '
+struct SpecialTable {
+    bool flags[256] = {};
+    SpecialTable() {
+        for (unsigned char c : {'&', '<', '>', '"', '\''}) flags[c] = true;
+    }
+};
+const SpecialTable specialTable;
+
+inline bool isSpecial(char c) {
+    return specialTable.flags[static_cast<unsigned char>(c)];
+}
+
+size_t findSpecialScalar(const char* data, size_t begin, size_t size) {
+    for (size_t i = begin; i < size; ++i) {
+        if (isSpecial(data[i])) return i;
+    }
+    return size;
+}
+
+#ifdef HTML_ESCAPE_X86
+
+inline unsigned lowestBit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+HTML_ESCAPE_TARGET("sse2")
+size_t findSpecialSSE2(const char* data, size_t size) {
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i apos = _mm_set1_epi8('\'');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, amp), _mm_cmpeq_epi8(block, lt)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(block, gt), _mm_cmpeq_epi8(block, quot)));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, apos));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+        if (mask != 0) return i + lowestBit(mask);
+    }
+    return findSpecialScalar(data, i, size);
+}
+
+HTML_ESCAPE_TARGET("avx2")
+size_t findSpecialAVX2(const char* data, size_t size) {
+    const __m256i amp = _mm256_set1_epi8('&');
+    const __m256i lt = _mm256_set1_epi8('<');
+    const __m256i gt = _mm256_set1_epi8('>');
+    const __m256i quot = _mm256_set1_epi8('"');
+    const __m256i apos = _mm256_set1_epi8('\'');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, amp), _mm256_cmpeq_epi8(block, lt)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(block, gt), _mm256_cmpeq_epi8(block, quot)));
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, apos));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask != 0) return i + lowestBit(mask);
+    }
+    // A 16-byte step keeps medium-length tails off the byte loop
+    if (i + 16 <= size) {
+        size_t found = findSpecialSSE2(data + i, size - i);
+        return i + found;
+    }
+    return findSpecialScalar(data, i, size);
+}
+
+#endif
+
+} // namespace
+
+// Most substituted values are a few bytes long; a vector setup costs more than it saves
+size_t HtmlEscape::findSpecial(const char* data, size_t size) {
+    if (size < 16) return findSpecialScalar(data, 0, size);
+    return findSpecial(data, size, TemplateScanner::level());
+}
+
+size_t HtmlEscape::findSpecial(const char* data, size_t size, TemplateScanner::Level level) {
+    if (size < 16) return findSpecialScalar(data, 0, size);
+    if (static_cast<int>(level) > static_cast<int>(TemplateScanner::detectedLevel())) {
+        level = TemplateScanner::detectedLevel();
+    }
+#ifdef HTML_ESCAPE_X86
+    if (level == TemplateScanner::Level::AVX2) return findSpecialAVX2(data, size);
+    if (level == TemplateScanner::Level::SSE2) return findSpecialSSE2(data, size);
+#endif
+    return findSpecialScalar(data, 0, size);
+}
+
+std::string_view HtmlEscape::entity(char c) {
+    switch (c) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '"': return "&quot;";
+        case '\'': return "&#39;";
+        default: return {};
+    }
+}
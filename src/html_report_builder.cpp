@@ -1,9 +1,13 @@
 #include "html_report_builder.h"
 #include "pdf_generator.h"
+#include "pdf_converter_thread.h"
+#include "pdf_merger.h"
+#include "pdf_metrics.h"
 #include "template_engine.h"
 #include "logging.hpp"
 #include <fmt/format.h>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <filesystem>
@@ -83,17 +87,22 @@ std::string HtmlReportBuilder::formatNumber(double value, int decimals) {
 }
 
 TemplateContext HtmlReportBuilder::buildContext() const {
+    return buildContext(0, sections_.size());
+}
+
+TemplateContext HtmlReportBuilder::buildContext(size_t firstSection, size_t sectionCount) const {
     TemplateContext ctx;
+    size_t endSection = std::min(sections_.size(), firstSection + sectionCount);
 
     // Page settings
     ctx.variables["page_size"] = isLandscape() ? "A4 landscape" : "A4";
     ctx.variables["orientation"] = isLandscape() ? "landscape" : "portrait";
-    ctx.variables["is_landscape"] = isLandscape() ? "1" : "";
-    ctx.variables["font_size"] = std::to_string(fontSize_.data);
-    ctx.variables["label_font_size"] = std::to_string(fontSize_.label);
-    ctx.variables["data_font_size"] = std::to_string(fontSize_.data);
-    ctx.variables["total_font_size"] = std::to_string(fontSize_.total);
-    ctx.variables["footer_font_size"] = std::to_string(fontSize_.footer);
+    ctx.variables["is_landscape"] = isLandscape();
+    ctx.variables["font_size"] = fontSize_.data;
+    ctx.variables["label_font_size"] = fontSize_.label;
+    ctx.variables["data_font_size"] = fontSize_.data;
+    ctx.variables["total_font_size"] = fontSize_.total;
+    ctx.variables["footer_font_size"] = fontSize_.footer;
 
     // Colors
     ctx.variables["header_fill_color"] = colorToHex(theme_.fillColorRed, theme_.fillColorGreen, theme_.fillColorBlue);
@@ -104,252 +113,198 @@ TemplateContext HtmlReportBuilder::buildContext() const {
         ctx.variables["custom_css"] = customCss_;
     }
 
-    // No data
-    if (noData_) {
-        ctx.variables["no_data"] = "1";
+    // No data (only shown when nothing else was added)
+    if (noData_ && sections_.empty()) {
+        ctx.variables["no_data"] = true;
         ctx.variables["no_data_text"] = noDataText_;
     }
 
-    // Compute column widths as percentages
-    double totalWeightage = 0;
-    for (const auto& col : columns_) {
-        totalWeightage += col.weightage;
-    }
-
-    // Build sections
-    std::vector<Item> sectionItems;
-    for (size_t si = 0; si < sections_.size(); ++si) {
-        const auto& sec = sections_[si];
-        Item sectionItem;
-        sectionItem.fields["title"] = sec.title;
-        sectionItem.fields["subtitle"] = sec.subtitle;
-        sectionItem.fields["date"] = ""; // Will be filled by caller or left as current date
-        sectionItem.fields["page_no"] = std::to_string(sec.pageNo);
-        sectionItem.fields["section_class"] = (si > 0) ? "section-break" : "";
-        sectionItem.fields["outlet_name"] = outletName_;
-        sectionItem.fields["show_page_no"] = showFooterPageNo_ ? "1" : "";
-
-        if (!sec.pageTitle.empty()) {
-            sectionItem.fields["page_title"] = sec.pageTitle;
-        }
-
-        // Build columns sub-list (we embed as a serialized format since TemplateEngine
-        // doesn't support nested {{#each}}. We'll use raw HTML injection instead.)
-        // Actually, our template uses {{#each columns}} within {{#each sections}}.
-        // The TemplateEngine doesn't support nested each blocks, so we need to
-        // pre-render the inner HTML for columns and rows.
-        // We'll do this by building the HTML directly for each section.
-
-        sectionItems.push_back(std::move(sectionItem));
-    }
-    ctx.lists["sections"] = sectionItems;
-
-    return ctx;
-}
-
-std::string HtmlReportBuilder::renderHtml() const {
-    // Since TemplateEngine doesn't support nested {{#each}} blocks,
-    // we build the HTML directly for maximum flexibility.
-
-    std::ostringstream html;
-    html << R"(<!DOCTYPE html>
-<html>
-<head>
-<meta charset="UTF-8">
-<style>
-    @page {
-        size: )" << (isLandscape() ? "A4 landscape" : "A4") << R"(;
-        margin: 10mm 10mm 15mm 10mm;
-    }
-    * { margin: 0; padding: 0; box-sizing: border-box; }
-    body {
-        font-family: Arial, sans-serif;
-        font-size: )" << fontSize_.data << R"(pt;
-        color: #333;
-    }
-    .header-row {
-        display: flex;
-        justify-content: space-between;
-        align-items: baseline;
-        margin-bottom: 2px;
-    }
-    .report-title { font-size: 10pt; }
-    .report-subtitle { font-size: 10pt; }
-    .report-date { font-size: 10pt; text-align: right; }
-    .page-title {
-        font-size: 8pt;
-        margin-bottom: 4px;
-        border-bottom: 1px solid #333;
-        padding-bottom: 2px;
-    }
-    table {
-        width: 100%;
-        border-collapse: collapse;
-        table-layout: fixed;
-    }
-    th {
-        background: )" << colorToHex(theme_.fillColorRed, theme_.fillColorGreen, theme_.fillColorBlue) << R"(;
-        color: #333;
-        font-size: )" << fontSize_.label << R"(pt;
-        font-weight: bold;
-        text-align: left;
-        padding: 2px 3px;
-        border: 1px solid )" << colorToHex(theme_.boxColorRed, theme_.boxColorGreen, theme_.boxColorBlue) << R"(;
-        overflow: hidden;
-        text-overflow: ellipsis;
-        white-space: nowrap;
-    }
-    td {
-        padding: 1px 3px;
-        border: 1px solid )" << colorToHex(theme_.boxColorRed, theme_.boxColorGreen, theme_.boxColorBlue) << R"(;
-        font-size: )" << fontSize_.data << R"(pt;
-        overflow: hidden;
-        text-overflow: ellipsis;
-        white-space: nowrap;
-        line-height: 1.4;
-    }
-    td:empty::after {
-        content: '\00a0';
-    }
-    .text-right { text-align: right; }
-    .text-left { text-align: left; }
-    .footer-row td {
-        font-weight: bold;
-        font-size: )" << fontSize_.total << R"(pt;
-        border-top: 2px solid )" << colorToHex(theme_.boxColorRed, theme_.boxColorGreen, theme_.boxColorBlue) << R"(;
-        border-bottom: 2px solid )" << colorToHex(theme_.boxColorRed, theme_.boxColorGreen, theme_.boxColorBlue) << R"(;
-    }
-    .grand-total-row td {
-        font-weight: bold;
-        font-size: )" << fontSize_.total << R"(pt;
-        border-top: 2px solid #333;
-        border-bottom: 2px solid #333;
-    }
-    .page-footer {
-        font-size: )" << fontSize_.footer << R"(pt;
-        color: #666;
-        margin-top: 4px;
-        overflow: hidden;
-    }
-    .page-footer-left { float: left; }
-    .page-footer-right { float: right; }
-    .section-break { page-break-before: always; }
-)";
-
-    if (!customCss_.empty()) {
-        html << customCss_ << "\n";
-    }
-
-    html << R"(</style>
-</head>
-<body>
-)";
+    // Footer
+    ctx.variables["outlet_name"] = outletName_;
+    ctx.variables["show_page_no"] = showFooterPageNo_;
 
     // Compute column widths as percentages
     double totalWeightage = 0;
     for (const auto& col : columns_) {
         totalWeightage += col.weightage;
     }
-    std::vector<double> colWidths;
+    std::vector<std::string> colWidths;
     for (const auto& col : columns_) {
-        colWidths.push_back(totalWeightage > 0 ? (col.weightage / totalWeightage * 100.0) : 0);
+        colWidths.push_back(fmt::format("{:.1f}", totalWeightage > 0 ? (col.weightage / totalWeightage * 100.0) : 0));
     }
 
-    int startOfs = breakPageOn_ ? 1 : 0;
+    // Column 0 only drives page breaks when breakPageOn is set
+    size_t startOfs = breakPageOn_ ? 1 : 0;
+
+    // Columns are shared by every section; {{#each columns}} inside a section
+    // falls back to this top-level list.
+    auto& columnItems = ctx.lists["columns"];
+    for (size_t ci = startOfs; ci < columns_.size(); ++ci) {
+        Item colItem;
+        colItem.fields["name"] = columns_[ci].name;
+        colItem.fields["width"] = colWidths[ci];
+        if (columns_[ci].isNumber) colItem.fields["is_number"] = true;
+        columnItems.push_back(std::move(colItem));
+    }
 
-    if (noData_ && sections_.empty()) {
-        html << R"(<div style="text-align:center; margin-top: 40mm;">
-    <p style="font-size: 12pt;">No Data for:</p>
-    <p style="font-size: 12pt; margin-top: 10mm;">)" << noDataText_ << R"(</p>
-</div>
-)";
+    // Keys used once per row/cell are interned up front
+    const TemplateKey valueKey("value");
+    const TemplateKey widthKey("width");
+    const TemplateKey isNumberKey("is_number");
+    const TemplateKey cellsKey("cells");
+
+    auto buildCells = [&](const std::vector<std::string>& cells, bool withWidth) {
+        std::vector<Item> cellItems;
+        cellItems.reserve(cells.size());
+        for (size_t ci = startOfs; ci < cells.size() && ci < columns_.size(); ++ci) {
+            Item cell;
+            cell.fields.reserve(withWidth ? 3 : 2);
+            cell.fields[valueKey] = cells[ci];
+            if (withWidth) cell.fields[widthKey] = colWidths[ci];
+            if (columns_[ci].isNumber) cell.fields[isNumberKey] = true;
+            cellItems.push_back(std::move(cell));
+        }
+        return cellItems;
+    };
+
+    if (hasGrandTotal_ && endSection == sections_.size()) {
+        ctx.lists["grand_total_cells"] = buildCells(grandTotalCells_, true);
     }
 
-    for (size_t si = 0; si < sections_.size(); ++si) {
+    // Build sections -> rows -> cells
+    auto& sectionItems = ctx.lists["sections"];
+    sectionItems.reserve(endSection - std::min(firstSection, endSection));
+    for (size_t si = firstSection; si < endSection; ++si) {
         const auto& sec = sections_[si];
-        html << "<div" << (si > 0 ? " class=\"section-break\"" : "") << ">\n";
-
-        // Header
-        html << "  <div class=\"header-row\">\n";
-        html << "    <span class=\"report-title\">" << sec.title << "</span>\n";
-        html << "    <span class=\"report-date\">" << sec.subtitle << "</span>\n";
-        html << "  </div>\n";
+        Item sectionItem;
+        sectionItem.fields["title"] = sec.title;
+        sectionItem.fields["subtitle"] = sec.subtitle;
+        sectionItem.fields["page_no"] = sec.pageNo;
+        sectionItem.fields["section_break"] = (si > firstSection);
 
         if (!sec.pageTitle.empty()) {
-            html << "  <div class=\"page-title\">" << sec.pageTitle << "</div>\n";
-        }
-
-        // Table
-        html << "  <table>\n    <thead><tr>\n";
-        for (size_t ci = startOfs; ci < columns_.size(); ++ci) {
-            const auto& col = columns_[ci];
-            html << "      <th style=\"width:" << fmt::format("{:.1f}", colWidths[ci])
-                 << "%\"" << (col.isNumber ? " class=\"text-right\"" : "") << ">"
-                 << col.name << "</th>\n";
+            sectionItem.fields["page_title"] = sec.pageTitle;
         }
-        html << "    </tr></thead>\n    <tbody>\n";
 
-        // Data rows
+        auto& rowItems = sectionItem.lists["rows"];
+        rowItems.reserve(sec.rows.size());
         for (const auto& row : sec.rows) {
-            html << "    <tr>\n";
-            for (size_t ci = startOfs; ci < row.cells.size() && ci < columns_.size(); ++ci) {
-                html << "      <td" << (columns_[ci].isNumber ? " class=\"text-right\"" : "")
-                     << ">" << row.cells[ci] << "</td>\n";
-            }
-            html << "    </tr>\n";
+            Item rowItem;
+            rowItem.lists[cellsKey] = buildCells(row.cells, false);
+            rowItems.push_back(std::move(rowItem));
         }
 
-        // Page total
         if (sec.hasPageTotal) {
-            html << "    <tr class=\"footer-row\">\n";
-            for (size_t ci = startOfs; ci < sec.pageTotalCells.size() && ci < columns_.size(); ++ci) {
-                html << "      <td" << (columns_[ci].isNumber ? " class=\"text-right\"" : "")
-                     << ">" << sec.pageTotalCells[ci] << "</td>\n";
-            }
-            html << "    </tr>\n";
+            sectionItem.fields["has_page_total"] = true;
+            sectionItem.lists["page_total_cells"] = buildCells(sec.pageTotalCells, false);
         }
 
-        html << "    </tbody>\n  </table>\n";
-
         // Grand total (only on last section)
         if (hasGrandTotal_ && si == sections_.size() - 1) {
-            html << "  <table><tr class=\"grand-total-row\">\n";
-            for (size_t ci = startOfs; ci < grandTotalCells_.size() && ci < columns_.size(); ++ci) {
-                html << "    <td style=\"width:" << fmt::format("{:.1f}", colWidths[ci])
-                     << "%\"" << (columns_[ci].isNumber ? " class=\"text-right\"" : "")
-                     << ">" << grandTotalCells_[ci] << "</td>\n";
-            }
-            html << "  </tr></table>\n";
+            sectionItem.fields["has_grand_total"] = true;
         }
 
-        // Footer
-        html << "  <div class=\"page-footer\">\n";
-        html << "    <span class=\"page-footer-left\">" << outletName_ << "</span>\n";
-        if (showFooterPageNo_) {
-            html << "    <span class=\"page-footer-right\">Page " << sec.pageNo << "</span>\n";
-        }
-        html << "  </div>\n";
+        sectionItems.push_back(std::move(sectionItem));
+    }
+
+    return ctx;
+}
 
-        html << "</div>\n";
+std::string HtmlReportBuilder::renderHtml() const {
+    return renderHtml(0, sections_.size());
+}
+
+std::string HtmlReportBuilder::renderHtml(size_t firstSection, size_t sectionCount) const {
+    if (!PdfMetrics::enabled()) {
+        return TemplateEngine::getCompiledTabularReportTemplate().render(buildContext(firstSection, sectionCount));
     }
 
-    html << "</body>\n</html>\n";
-    return html.str();
+    auto start = std::chrono::steady_clock::now();
+    TemplateContext context = buildContext(firstSection, sectionCount);
+    auto built = std::chrono::steady_clock::now();
+    std::string html = TemplateEngine::getCompiledTabularReportTemplate().render(context);
+    auto& metrics = PdfMetrics::shared();
+    metrics.record(PdfMetrics::Stage::BuildContext, "tabular_report", html.size(), built - start);
+    metrics.record(PdfMetrics::Stage::Render, "tabular_report", html.size(), std::chrono::steady_clock::now() - built);
+    return html;
 }
 
-bool HtmlReportBuilder::generatePdf(const std::string& outputPath) const {
-    std::string htmlContent = renderHtml();
+// Helper: conversion request for rendered report HTML
+static htmlToPDF::PdfGenerateRequest reportRequest(std::string html, const std::string& outputPath, bool landscape) {
+    htmlToPDF::PdfGenerateRequest request;
+    request.type = htmlToPDF::PdfGenerateRequest::RequestType::GenerateFromHtml;
+    request.htmlContent = std::move(html);
+    request.outputPath = outputPath;
+    request.control.templateName = "tabular_report";
 
-    htmlToPDF::PdfGenerator::PdfSettings settings;
-    settings.orientation = isLandscape() ? "Landscape" : "Portrait";
+    auto& settings = request.settings;
+    settings.orientation = landscape ? "Landscape" : "Portrait";
     settings.pageSize = "A4";
     settings.marginTop = 10;
     settings.marginBottom = 10;
     settings.marginLeft = 10;
     settings.marginRight = 10;
+    return request;
+}
 
+// Helper: convert the report in groups of groupSize sections and join them at
+// outputPath, with "of totalPages" in every footer. Each group is rendered,
+// converted and appended before the next is rendered, so only one group's
+// context, HTML, WebKit page and PDF exist at a time. Returns the page count, or -1.
+template <typename Converter>
+static int convertInGroups(const HtmlReportBuilder& report, Converter& converter, const std::string& outputPath,
+                           size_t groupSize, int totalPages) {
+    std::string partPath = outputPath + ".part";
+    size_t sections = static_cast<size_t>(report.sectionCount());
+    bool success = true;
+    int pages = 0;
+    {
+        htmlToPDF::PdfMerger merger(outputPath);
+        for (size_t first = 0; success && first < sections; first += groupSize) {
+            auto request = reportRequest(report.renderHtml(first, groupSize), partPath, report.isLandscape());
+            // wkhtmltopdf only knows the pages of its own part, so the total is written out
+            request.settings.pageOffset = merger.pageCount();
+            request.settings.footerRight = fmt::format("Page [page] of {}", totalPages);
+            success = converter.execute(std::move(request)).success && merger.appendFile(partPath);
+        }
+        success = success && merger.finish();
+        pages = merger.pageCount();
+    }
+    std::error_code ec;
+    std::filesystem::remove(partPath, ec);
+    return success ? pages : -1;
+}
+
+bool HtmlReportBuilder::generatePdf(const std::string& outputPath) const {
+#if HTMLTOPDF_WITH_WX
     htmlToPDF::PdfGeneratorProxy proxy;
-    return proxy.generateFromHtml(htmlContent, outputPath, settings);
+#else
+    auto& proxy = htmlToPDF::PdfConverterThread::shared();
+#endif
+    if (chunkPages_ <= 0 || sections_.size() <= static_cast<size_t>(chunkPages_)) {
+        return proxy.execute(reportRequest(renderHtml(), outputPath, isLandscape())).success;
+    }
+
+    // Every section starts a page, so the section count is the page total unless
+    // a section overflows onto more pages. Then the parts are converted once more
+    // with the real total, which the first pass has counted.
+    size_t groupSize = static_cast<size_t>(chunkPages_);
+    int totalPages = static_cast<int>(sections_.size());
+    int pages = convertInGroups(*this, proxy, outputPath, groupSize, totalPages);
+    if (pages > 0 && pages != totalPages) {
+        LOG_INFO("Report {} has {} pages, not {}; converting again for the footer total", outputPath, pages, totalPages);
+        totalPages = pages;
+        pages = convertInGroups(*this, proxy, outputPath, groupSize, totalPages);
+    }
+    std::error_code ec;
+    if (pages != totalPages) {
+        LOG_ERROR("Chunked report conversion of {} failed", outputPath);
+        std::filesystem::remove(outputPath, ec);
+        return false;
+    }
+    LOG_INFO("Report {} converted in {} groups of {} sections", outputPath,
+             (sections_.size() + groupSize - 1) / groupSize, groupSize);
+    return true;
 }
 
 bool HtmlReportBuilder::saveAsFile(const std::wstring& filePath) const {
@@ -0,0 +1,234 @@
+#include "image_generator.h"
+#include "pdf_metrics.h"
+#include <wkhtmltox/image.h>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <string_view>
+#include "logging.hpp"
+
+extern std::string GetVersionNo();
+
+namespace htmlToPDF {
+
+// Paper sizes in millimetres, portrait
+struct PaperSize {
+    const char* name;
+    double widthMm;
+    double heightMm;
+};
+
+static const PaperSize paperSizes[] = {
+    {"A3", 297, 420}, {"A4", 210, 297}, {"A5", 148, 210}, {"Letter", 215.9, 279.4}, {"Legal", 215.9, 355.6},
+};
+
+// Helper: paper by name, ignoring case; A4 if unknown
+static const PaperSize& paperSize(const std::string& name) {
+    for (const auto& paper : paperSizes) {
+        std::string_view candidate(paper.name);
+        if (candidate.size() == name.size() &&
+            std::equal(candidate.begin(), candidate.end(), name.begin(), [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            })) {
+            return paper;
+        }
+    }
+    LOG_WARN("Unknown preview page size {}, using A4", name);
+    return paperSizes[1];
+}
+
+// Helper: millimetres to CSS pixels (96 per inch)
+static double cssPixels(double mm) {
+    return mm / 25.4 * 96.0;
+}
+
+static void imageErrorCallback(wkhtmltoimage_converter* /*converter*/, const char* msg) {
+    if (msg) {
+        LOG_ERROR("wkhtmltoimage: {}", msg);
+    }
+}
+
+static void imageWarningCallback(wkhtmltoimage_converter* /*converter*/, const char* msg) {
+    if (msg) {
+        LOG_WARN("wkhtmltoimage: {}", msg);
+    }
+}
+
+// The job of the preview running under PdfGenerator::mutex_, for the progress callbacks
+static const PdfJobControl* activeJob = nullptr;
+
+// Helper: forward a progress update to the active job; exceptions must not cross wkhtmltoimage
+static void reportProgress(wkhtmltoimage_converter* converter, int percent) {
+    if (activeJob == nullptr || !activeJob->onProgress) return;
+    PdfProgress progress;
+    progress.phase = wkhtmltoimage_current_phase(converter);
+    progress.phaseCount = wkhtmltoimage_phase_count(converter);
+    const char* description = wkhtmltoimage_phase_description(converter, progress.phase);
+    progress.phaseDescription = description ? description : "";
+    progress.percent = percent;
+    try {
+        activeJob->onProgress(progress);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Preview progress callback threw: {}", e.what());
+    }
+}
+
+static void imagePhaseCallback(wkhtmltoimage_converter* converter) {
+    reportProgress(converter, 0);
+}
+
+static void imageProgressCallback(wkhtmltoimage_converter* converter, const int percent) {
+    reportProgress(converter, percent);
+}
+
+bool ImageGenerator::initialized_ = false;
+
+ImageGenerator::ImageGenerator() : config_() {}
+
+ImageGenerator::ImageGenerator(const ImageConfig& config) : config_(config) {}
+
+// Call this ONCE from main() before creating any threads
+bool ImageGenerator::initLibrary() {
+    if (initialized_) return true;
+    if (wkhtmltoimage_init(0) != 1) {
+        LOG_ERROR("Failed to initialize wkhtmltoimage library");
+        return false;
+    }
+    initialized_ = true;
+    LOG_INFO("wkhtmltoimage library initialized");
+    return true;
+}
+
+void ImageGenerator::deinitLibrary() {
+    if (initialized_) {
+        wkhtmltoimage_deinit();
+        initialized_ = false;
+    }
+}
+
+PdfCache::Key ImageGenerator::cacheKey(std::string_view html, const ImageConfig& config) {
+    PdfCache::KeyBuilder key;
+    key.add("image").add(config.format).add(config.dpi).add(config.quality).add(config.page);
+    key.add(config.pageSize).add(config.landscape ? 1 : 0).add(config.enableLocalFileAccess ? 1 : 0);
+    key.add(GetVersionNo()).add(html);
+    return key.finish();
+}
+
+bool ImageGenerator::generateToBuffer(const std::string& htmlContent, std::string& image) {
+    return doConvert(htmlContent, "", &image);
+}
+
+bool ImageGenerator::generateToFile(const std::string& htmlContent, const std::string& outputPath) {
+    return doConvert(htmlContent, outputPath, nullptr);
+}
+
+PdfOutput ImageGenerator::generateToOutput(const std::string& htmlContent) {
+    std::string image;
+    if (!doConvert(htmlContent, "", &image)) return PdfOutput();
+    return PdfOutput(std::make_shared<const std::string>(std::move(image)));
+}
+
+bool ImageGenerator::doConvert(const std::string& htmlContent, const std::string& outputPath, std::string* image) {
+    PdfCache::Key key;
+    if (cache_) {
+        key = cacheKey(htmlContent, config_);
+        if (auto cached = cache_->find(key)) {
+            if (image != nullptr) image->assign(*cached);
+            return outputPath.empty() || PdfCache::writeFile(*cached, outputPath);
+        }
+    }
+
+    PdfJobControl job = control_;
+    job.arm();
+    std::unique_lock<std::timed_mutex> lock;
+    if (!PdfGenerator::lockForJob(lock, job, htmlContent, htmlContent.size())) return false;
+
+    if (!initialized_) {
+        LOG_ERROR("wkhtmltoimage not initialized - call initLibrary() from main thread at startup");
+        return false;
+    }
+
+    wkhtmltoimage_global_settings* gs = wkhtmltoimage_create_global_settings();
+    if (!gs) {
+        LOG_ERROR("Failed to create image settings");
+        return false;
+    }
+
+    // Lay the document out at the paper width, scaled so one CSS inch is dpi pixels
+    const PaperSize& paper = paperSize(config_.pageSize);
+    double zoom = std::clamp(config_.dpi, 8, 300) / 96.0;
+    double pageWidth = cssPixels(config_.landscape ? paper.heightMm : paper.widthMm) * zoom;
+    double pageHeight = cssPixels(config_.landscape ? paper.widthMm : paper.heightMm) * zoom;
+    int width = static_cast<int>(std::lround(pageWidth));
+
+    if (!outputPath.empty()) {
+        wkhtmltoimage_set_global_setting(gs, "out", outputPath.c_str());
+    }
+    wkhtmltoimage_set_global_setting(gs, "fmt", config_.format.c_str());
+    wkhtmltoimage_set_global_setting(gs, "quality", std::to_string(std::clamp(config_.quality, 1, 100)).c_str());
+    wkhtmltoimage_set_global_setting(gs, "zoom", std::to_string(zoom).c_str());
+    wkhtmltoimage_set_global_setting(gs, "screenWidth", std::to_string(width).c_str());
+    wkhtmltoimage_set_global_setting(gs, "smartWidth", "false");
+    wkhtmltoimage_set_global_setting(gs, "crop.left", "0");
+    wkhtmltoimage_set_global_setting(gs, "crop.width", std::to_string(width).c_str());
+    if (config_.page > 0) {
+        long top = std::lround(pageHeight * (config_.page - 1));
+        wkhtmltoimage_set_global_setting(gs, "crop.top", std::to_string(top).c_str());
+        wkhtmltoimage_set_global_setting(gs, "crop.height", std::to_string(std::lround(pageHeight)).c_str());
+    }
+    wkhtmltoimage_set_global_setting(gs, "load.blockLocalFileAccess", config_.enableLocalFileAccess ? "false" : "true");
+
+    // The HTML is passed as data, so nothing is written to disk on the way in
+    wkhtmltoimage_converter* converter = wkhtmltoimage_create_converter(gs, htmlContent.c_str());
+    if (!converter) {
+        LOG_ERROR("Failed to create image converter");
+        return false;
+    }
+    wkhtmltoimage_set_error_callback(converter, imageErrorCallback);
+    wkhtmltoimage_set_warning_callback(converter, imageWarningCallback);
+    if (job.onProgress) {
+        wkhtmltoimage_set_phase_changed_callback(converter, imagePhaseCallback);
+        wkhtmltoimage_set_progress_changed_callback(converter, imageProgressCallback);
+    }
+
+    bool success;
+    {
+        PdfMetrics::Timer timer(PdfMetrics::Stage::Convert, job.templateName, htmlContent.size());
+        activeJob = &job;
+        success = (wkhtmltoimage_convert(converter) == 1);
+        activeJob = nullptr;
+    }
+    // Like a PDF, a late or cancelled preview is discarded
+    if (PdfGenerator::abandonJob(job, "during preview", htmlContent, htmlContent.size())) {
+        wkhtmltoimage_destroy_converter(converter);
+        return false;
+    }
+    PdfMetrics::shared().countDocument(success ? PdfMetrics::Outcome::Succeeded : PdfMetrics::Outcome::Failed,
+                                       job.templateName, htmlContent.size());
+
+    // wkhtmltoimage keeps the image in memory only when there is no output file
+    std::string output;
+    if (success && image != nullptr) {
+        const unsigned char* data = nullptr;
+        long len = wkhtmltoimage_get_output(converter, &data);
+        if (len > 0 && data != nullptr) output.assign(reinterpret_cast<const char*>(data), static_cast<size_t>(len));
+    }
+    wkhtmltoimage_destroy_converter(converter);
+    lock.unlock();
+
+    if (!success) {
+        LOG_ERROR("Preview conversion failed");
+        return false;
+    }
+    if (!outputPath.empty()) {
+        LOG_INFO("Preview generated: {}", outputPath);
+    }
+    if (cache_) {
+        if (!outputPath.empty()) cache_->storeFile(key, outputPath);
+        else if (!output.empty()) cache_->store(key, output);
+    }
+    if (image != nullptr) *image = std::move(output);
+    return true;
+}
+
+} // namespace htmlToPDF
@@ -1,6 +1,6 @@
 #include "invoice_builder.h"
-#include <sstream>
-#include <iomanip>
+#include "qr_code.h"
+#include "pdf_metrics.h"
 #include <cstdio>
 #include "logger.h"
 
@@ -12,47 +12,11 @@ std::string InvoicePDFBuilder::colorToHex(unsigned char r, unsigned char g, unsi
 }
 
 std::string InvoicePDFBuilder::formatNumber(double value, int decimals) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(decimals) << value;
-    std::string numStr = oss.str();
-    
-    // Add thousand separators
-    size_t dotPos = numStr.find('.');
-    std::string intPart = (dotPos != std::string::npos) ? numStr.substr(0, dotPos) : numStr;
-    std::string decPart = (dotPos != std::string::npos) ? numStr.substr(dotPos) : "";
-    
-    // Handle negative numbers
-    bool isNegative = (!intPart.empty() && intPart[0] == '-');
-    if (isNegative) intPart = intPart.substr(1);
-    
-    // Insert commas from right to left
-    std::string result;
-    int count = 0;
-    for (int i = static_cast<int>(intPart.length()) - 1; i >= 0; --i) {
-        if (count > 0 && count % 3 == 0) result = ',' + result;
-        result = intPart[i] + result;
-        ++count;
-    }
-    
-    if (isNegative) result = '-' + result;
-    return result + decPart;
+    return TemplateValue::number(value, decimals).str();
 }
 
 std::string InvoicePDFBuilder::formatQuantity(double value) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(2) << value;
-    std::string result = oss.str();
-    // Remove trailing zeros
-    size_t dotPos = result.find('.');
-    if (dotPos != std::string::npos) {
-        size_t lastNonZero = result.find_last_not_of('0');
-        if (lastNonZero == dotPos) {
-            result = result.substr(0, dotPos);
-        } else if (lastNonZero != std::string::npos) {
-            result = result.substr(0, lastNonZero + 1);
-        }
-    }
-    return result;
+    return TemplateValue::quantity(value).str();
 }
 
 int InvoicePDFBuilder::getItemsPerPage(bool isLandscape, const PaginationConfig& config) {
@@ -123,8 +87,8 @@ TemplateContext InvoicePDFBuilder::buildContext(const InvoiceData& data) {
     // Document info
     vars["document_type"] = data.documentType;
     vars["ref_title"] = data.refTitle;
-    vars["is_draft"] = data.isDraft ? "1" : "";
-    vars["is_landscape"] = data.isLandscape ? "1" : "";
+    vars["is_draft"] = data.isDraft;
+    vars["is_landscape"] = data.isLandscape;
     vars["orientation"] = data.isLandscape ? "landscape" : "portrait";
     
     // Header info
@@ -132,9 +96,9 @@ TemplateContext InvoicePDFBuilder::buildContext(const InvoiceData& data) {
     vars["ref_no"] = data.refNo;
     vars["transaction_date"] = data.transactionDate;
     vars["term"] = data.term;
-    vars["page_no"] = std::to_string(data.pageNo);
-    vars["total_pages"] = std::to_string(data.totalPages);
-    vars["is_last_page"] = (data.pageNo == data.totalPages) ? "1" : "";
+    vars["page_no"] = data.pageNo;
+    vars["total_pages"] = data.totalPages;
+    vars["is_last_page"] = (data.pageNo == data.totalPages);
     
     // Outlet info
     vars["outlet_name"] = data.outlet.name;
@@ -142,6 +106,8 @@ TemplateContext InvoicePDFBuilder::buildContext(const InvoiceData& data) {
     vars["outlet_address"] = data.outlet.address;
     vars["outlet_reg_no"] = data.outlet.regNo;
     vars["outlet_gst_reg_no"] = data.outlet.gstRegNo;
+    // Left as a path: no built-in template shows it. A custom template that
+    // does should call AssetCache::inlineImages() on the context.
     vars["outlet_logo"] = data.outlet.logoPath;
     
     // Party info
@@ -151,24 +117,24 @@ TemplateContext InvoicePDFBuilder::buildContext(const InvoiceData& data) {
     vars["deliver_to_name"] = data.deliverTo.name;
     vars["deliver_to_address"] = data.deliverTo.address;
     vars["deliver_to_id"] = data.deliverTo.id;
-    vars["show_deliver_to"] = data.showDeliverTo ? "1" : "";
-    vars["show_account_id"] = data.showAccountId ? "1" : "";
+    vars["show_deliver_to"] = data.showDeliverTo;
+    vars["show_account_id"] = data.showAccountId;
     
     // Display flags
-    vars["show_code"] = data.showCode ? "1" : "";
-    vars["show_mal"] = data.showMal ? "1" : "";
-    vars["show_batch_expiry"] = data.showBatchExpiry ? "1" : "";
-    vars["show_bonus"] = data.showBonus ? "1" : "";
-    vars["show_srp"] = data.showSrp ? "1" : "";
-    vars["show_discount"] = data.showDiscount ? "1" : "";
-    vars["show_gst"] = data.showGst ? "1" : "";
-    vars["show_minimal"] = data.showMinimal ? "1" : "";
+    vars["show_code"] = data.showCode;
+    vars["show_mal"] = data.showMal;
+    vars["show_batch_expiry"] = data.showBatchExpiry;
+    vars["show_bonus"] = data.showBonus;
+    vars["show_srp"] = data.showSrp;
+    vars["show_discount"] = data.showDiscount;
+    vars["show_gst"] = data.showGst;
+    vars["show_minimal"] = data.showMinimal;
     
     // Purchase order flags
-    vars["is_purchase_order"] = data.isPurchaseOrder ? "1" : "";
-    vars["is_goods_received"] = data.isGoodsReceived ? "1" : "";
-    vars["is_goods_return"] = data.isGoodsReturn ? "1" : "";
-    vars["is_invoice"] = (!data.isPurchaseOrder && !data.isGoodsReceived && !data.isGoodsReturn) ? "1" : "";
+    vars["is_purchase_order"] = data.isPurchaseOrder;
+    vars["is_goods_received"] = data.isGoodsReceived;
+    vars["is_goods_return"] = data.isGoodsReturn;
+    vars["is_invoice"] = (!data.isPurchaseOrder && !data.isGoodsReceived && !data.isGoodsReturn);
     
     // Party label - derive from document type
     if (data.isPurchaseOrder) {
@@ -190,41 +156,35 @@ TemplateContext InvoicePDFBuilder::buildContext(const InvoiceData& data) {
         vars["items_label"] = "Items sold:";
     }
     
-    // Line items - copy display flags into each item for template loop conditionals
+    // Line items - display flags (show_code, show_gst, ...) resolve from the root variables
+    auto& items = ctx.lists["items"];
+    items.reserve(data.items.size());
     for (const auto& item : data.items) {
         Item it;
-        it.fields["line_no"] = std::to_string(item.lineNo);
+        it.fields.reserve(16);
+        it.fields["line_no"] = item.lineNo;
         it.fields["code"] = item.code;
         it.fields["mal"] = item.mal;
         it.fields["name"] = item.name;
         it.fields["packing"] = item.packing;
         it.fields["batch_no"] = item.batchNo;
         it.fields["expiry_date"] = item.expiryDate;
-        it.fields["quantity"] = formatQuantity(item.quantity);
-        it.fields["bonus"] = formatQuantity(item.bonus);
-        it.fields["price"] = formatNumber(item.price);
-        it.fields["net_price"] = formatNumber(item.netPrice);
-        it.fields["selling_price"] = formatNumber(item.sellingPrice);
-        it.fields["margin"] = formatNumber(item.margin);
-        it.fields["discount"] = formatNumber(item.discount);
-        it.fields["gst"] = formatNumber(item.gst);
-        it.fields["amount"] = formatNumber(item.amount);
-        // Copy display flags so conditionals work inside the loop
-        it.fields["show_code"] = data.showCode ? "1" : "";
-        it.fields["show_mal"] = data.showMal ? "1" : "";
-        it.fields["show_batch_expiry"] = data.showBatchExpiry ? "1" : "";
-        it.fields["show_bonus"] = data.showBonus ? "1" : "";
-        it.fields["show_srp"] = data.showSrp ? "1" : "";
-        it.fields["show_discount"] = data.showDiscount ? "1" : "";
-        it.fields["show_gst"] = data.showGst ? "1" : "";
-        it.fields["show_minimal"] = data.showMinimal ? "1" : "";
-        ctx.lists["items"].push_back(it);
+        it.fields["quantity"] = TemplateValue::quantity(item.quantity);
+        it.fields["bonus"] = TemplateValue::quantity(item.bonus);
+        it.fields["price"] = TemplateValue::number(item.price);
+        it.fields["net_price"] = TemplateValue::number(item.netPrice);
+        it.fields["selling_price"] = TemplateValue::number(item.sellingPrice);
+        it.fields["margin"] = TemplateValue::number(item.margin);
+        it.fields["discount"] = TemplateValue::number(item.discount);
+        it.fields["gst"] = TemplateValue::number(item.gst);
+        it.fields["amount"] = TemplateValue::number(item.amount);
+        items.push_back(std::move(it));
     }
     
     // Totals
-    vars["total_amount"] = formatNumber(data.totalAmount);
-    vars["total_gst"] = formatNumber(data.totalGst);
-    vars["total_discount"] = formatNumber(data.totalDiscount);
+    vars["total_amount"] = TemplateValue::number(data.totalAmount);
+    vars["total_gst"] = TemplateValue::number(data.totalGst);
+    vars["total_discount"] = TemplateValue::number(data.totalDiscount);
     
     // Notes
     for (const auto& note : data.notes) {
@@ -237,23 +197,47 @@ TemplateContext InvoicePDFBuilder::buildContext(const InvoiceData& data) {
         it.fields["text"] = remark;
         ctx.lists["remarks"].push_back(it);
     }
-    vars["has_remarks"] = !data.remarks.empty() ? "1" : "";
-    
-    // e-Invoice - add data URI prefix for base64 PNG
-    if (!data.eInvoicePNG.empty()) {
-        std::string dataUri = "data:image/png;base64," + data.eInvoicePNG;
-        LOG_INFO("e_invoice_png length: {}, prefix: {}", dataUri.length(), dataUri.substr(0, 50));
-        vars["e_invoice_png"] = dataUri;
-        vars["has_e_invoice"] = "1";
-    } else {
-        LOG_INFO("e_invoice_png is EMPTY");
-        vars["e_invoice_png"] = "";
-        vars["has_e_invoice"] = "";
+    vars["has_remarks"] = !data.remarks.empty();
+    
+    // e-Invoice - QR code of the validation link, encoded once per link (every page shows it)
+    std::shared_ptr<const std::string> qr = data.eInvoiceUrl.empty() ? nullptr : QrCode::svg(data.eInvoiceUrl);
+    if (!data.eInvoiceUrl.empty() && !qr) {
+        LOG_WARN("e-Invoice link of {} is too long for a QR code", data.refNo);
     }
+    vars["e_invoice_svg"] = qr ? *qr : std::string();
+    vars["e_invoice_png"] = data.eInvoicePNG.empty() ? std::string() : "data:image/png;base64," + data.eInvoicePNG;
+    vars["has_e_invoice"] = qr != nullptr || !data.eInvoicePNG.empty();
     
     return ctx;
 }
 
+std::vector<std::string> InvoicePDFBuilder::renderPages(const CompiledTemplate& pageTemplate,
+                                                       const InvoiceData& data, const PaginationConfig& config) {
+    std::vector<std::string> html;
+    TemplateFragmentCache cache;
+    bool timed = PdfMetrics::enabled();
+    std::chrono::steady_clock::duration building{}, rendering{};
+    size_t documentBytes = 0;
+    for (const auto& page : paginateInvoice(data, config)) {
+        if (!timed) {
+            html.push_back(pageTemplate.render(buildContext(page), cache));
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        TemplateContext context = buildContext(page);
+        auto built = std::chrono::steady_clock::now();
+        html.push_back(pageTemplate.render(context, cache));
+        building += built - start;
+        rendering += std::chrono::steady_clock::now() - built;
+        documentBytes += html.back().size();
+    }
+    if (timed) {
+        PdfMetrics::shared().record(PdfMetrics::Stage::BuildContext, "paginated_invoice", documentBytes, building);
+        PdfMetrics::shared().record(PdfMetrics::Stage::Render, "paginated_invoice", documentBytes, rendering);
+    }
+    return html;
+}
+
 // BillingStatementPDFBuilder implementations
 std::string BillingStatementPDFBuilder::colorToHex(unsigned char r, unsigned char g, unsigned char b) {
     return InvoicePDFBuilder::colorToHex(r, g, b);
@@ -295,30 +279,26 @@ TemplateContext BillingStatementPDFBuilder::buildContext(const BillingData& data
     vars["debtor_name"] = debtor.name;
     vars["debtor_address"] = debtor.address;
     vars["debtor_id"] = debtor.debtorId;
-    vars["total_amount"] = formatNumber(debtor.totalAmount);
-    vars["term"] = formatNumber(debtor.term);
+    vars["total_amount"] = TemplateValue::number(debtor.totalAmount);
+    vars["term"] = TemplateValue::number(debtor.term);
     
-    // Customer records with nested items
+    // Customer records, each owning its items for the nested {{#each items}}
     for (const auto& customer : debtor.customers) {
         Item custItem;
         custItem.fields["name"] = customer.name;
         custItem.fields["ic"] = customer.ic;
-        custItem.fields["total"] = formatNumber(customer.total);
-        
-        // Build items as a single string for now (simplified)
-        // In a more complex template, we'd need nested loops support
-        ctx.lists["customers"].push_back(custItem);
+        custItem.fields["total"] = TemplateValue::number(customer.total);
         
-        // Add items to a flat list with customer reference
+        auto& items = custItem.lists["items"];
         for (const auto& item : customer.items) {
             Item itemData;
-            itemData.fields["customer_name"] = customer.name;
             itemData.fields["item"] = item.item;
             itemData.fields["sales_ids"] = item.salesIds;
-            itemData.fields["quantity"] = formatNumber(item.quantity);
-            itemData.fields["amount"] = formatNumber(item.amount);
-            ctx.lists["all_items"].push_back(itemData);
+            itemData.fields["quantity"] = TemplateValue::number(item.quantity);
+            itemData.fields["amount"] = TemplateValue::number(item.amount);
+            items.push_back(std::move(itemData));
         }
+        ctx.lists["customers"].push_back(std::move(custItem));
     }
     
     return ctx;
@@ -348,7 +328,7 @@ TemplateContext PoisonOrderPDFBuilder::buildContext(const PoisonOrderData& data)
     vars["letterhead_fill_color"] = data.theme.letterheadFillRect ? colorToHex(data.theme.fillColorRed, data.theme.fillColorGreen, data.theme.fillColorBlue) : "#ffffff";
     
     // Orientation
-    vars["is_landscape"] = data.isLandscape ? "1" : "";
+    vars["is_landscape"] = data.isLandscape;
     vars["orientation"] = data.isLandscape ? "landscape" : "portrait";
     
     // Header info
@@ -357,8 +337,8 @@ TemplateContext PoisonOrderPDFBuilder::buildContext(const PoisonOrderData& data)
     vars["ref_no"] = data.refNo;
     vars["transaction_date"] = data.transactionDate;
     vars["term"] = data.term;
-    vars["page_no"] = std::to_string(data.pageNo);
-    vars["total_pages"] = std::to_string(data.totalPages);
+    vars["page_no"] = data.pageNo;
+    vars["total_pages"] = data.totalPages;
     
     // Outlet info
     vars["outlet_name"] = data.outlet.name;
@@ -370,19 +350,19 @@ TemplateContext PoisonOrderPDFBuilder::buildContext(const PoisonOrderData& data)
     vars["deliver_to_name"] = data.deliverTo.name;
     vars["deliver_to_address"] = data.deliverTo.address;
     vars["account_id"] = data.accountId;
-    vars["show_account_id"] = data.showAccountId ? "1" : "";
+    vars["show_account_id"] = data.showAccountId;
     vars["purpose_of_sale"] = data.purposeOfSale;
     
     // Items
     for (const auto& item : data.items) {
         Item it;
-        it.fields["line_no"] = std::to_string(item.lineNo);
+        it.fields["line_no"] = item.lineNo;
         it.fields["code"] = item.code;
         it.fields["mal"] = item.mal;
         it.fields["name"] = item.name;
         it.fields["batch_no"] = item.batchNo;
         it.fields["expiry_date"] = item.expiryDate;
-        it.fields["quantity"] = formatQuantity(item.quantity);
+        it.fields["quantity"] = TemplateValue::quantity(item.quantity);
         it.fields["uom"] = item.uom;
         ctx.lists["items"].push_back(it);
     }
@@ -1,12 +1,20 @@
 #include "template_engine.h"
+#include "asset_cache.h"
 #include "pdf_generator.h"
+#include "pdf_worker_pool.h"
 #include <iostream>
 
 int main(int argc, char* argv[]) {
+    // Started by a PdfWorkerPool: serve conversions instead of running the examples
+    if (PdfWorkerPool::isWorkerCommandLine(argc, argv)) return PdfWorkerPool::runWorker();
+
     std::cout << "Handlebars Template to PDF Generator\n";
     std::cout << "=====================================\n\n";
     
-    PdfGenerator generator;
+    // Images are inlined into the HTML by AssetCache, so WebKit runs with local
+    // file access off (the PdfConfig default)
+    PdfConfig config;
+    PdfGenerator generator(config);
     
     // Example 1: Generate an invoice PDF with line items
     {
@@ -64,7 +72,8 @@ int main(int argc, char* argv[]) {
             {{{"description", "32. UI/UX Design"}, {"qty", "10"}, {"unit_price", "100.00"}, {"amount", "1,000.00"}}},
             {{{"description", "33. Server Setup & Configuration"}, {"qty", "5"}, {"unit_price", "100.00"}, {"amount", "500.00"}}}};
 
-        std::string html = TemplateEngine::render(TemplateEngine::getInvoiceTemplate(), ctx);
+        AssetCache::shared().inlineImages(ctx);
+        std::string html = TemplateEngine::getCompiledInvoiceTemplate().render(ctx);
         generator.generate(html, "invoice.pdf");
     }
     
@@ -114,7 +123,8 @@ int main(int argc, char* argv[]) {
             {{{"col1", "25. Region D - Online"}, {"col2", "78,300"}, {"col3", "+18%"}}},
             {{{"col1", "TOTAL"}, {"col2", "347,000"}, {"col3", "+15%"}}}};
 
-        std::string html = TemplateEngine::render(TemplateEngine::getReportTemplate(), ctx);
+        AssetCache::shared().inlineImages(ctx);
+        std::string html = TemplateEngine::getCompiledReportTemplate().render(ctx);
         generator.generate(html, "report.pdf");
     }
     
@@ -134,7 +144,8 @@ int main(int argc, char* argv[]) {
                      "Should you have any questions, please do not hesitate to contact us."}
         };
         
-        std::string html = TemplateEngine::render(TemplateEngine::getLetterTemplate(), ctx);
+        AssetCache::shared().inlineImages(ctx);
+        std::string html = TemplateEngine::getCompiledLetterTemplate().render(ctx);
         generator.generate(html, "letter.pdf");
     }
     
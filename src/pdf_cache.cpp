@@ -0,0 +1,357 @@
+#include "pdf_cache.h"
+#include "logging.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace htmlToPDF {
+
+namespace {
+
+const uint32_t sha256Rounds[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t rotr(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+// Helper: read a spilled PDF; false if it is missing or unreadable
+bool readFile(const fs::path& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    if (size < 0) return false;
+    file.seekg(0);
+    out.resize(static_cast<size_t>(size));
+    file.read(out.data(), size);
+    return static_cast<std::streamoff>(file.gcount()) == size;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// KeyBuilder (SHA-256)
+// ---------------------------------------------------------------------------
+
+PdfCache::KeyBuilder::KeyBuilder()
+    : state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {
+}
+
+PdfCache::KeyBuilder& PdfCache::KeyBuilder::add(std::string_view part) {
+    add(static_cast<long long>(part.size()));
+    update(reinterpret_cast<const uint8_t*>(part.data()), part.size());
+    return *this;
+}
+
+PdfCache::KeyBuilder& PdfCache::KeyBuilder::add(long long value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i) bytes[i] = static_cast<uint8_t>(static_cast<unsigned long long>(value) >> (8 * i));
+    update(bytes, sizeof(bytes));
+    return *this;
+}
+
+void PdfCache::KeyBuilder::update(const uint8_t* data, size_t size) {
+    totalSize_ += size;
+    if (blockSize_ > 0) {
+        size_t take = std::min(size, sizeof(block_) - blockSize_);
+        std::memcpy(block_ + blockSize_, data, take);
+        blockSize_ += take;
+        data += take;
+        size -= take;
+        if (blockSize_ < sizeof(block_)) return;
+        compress(block_);
+        blockSize_ = 0;
+    }
+    for (; size >= sizeof(block_); data += sizeof(block_), size -= sizeof(block_)) compress(data);
+    std::memcpy(block_, data, size);
+    blockSize_ = size;
+}
+
+void PdfCache::KeyBuilder::compress(const uint8_t* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = uint32_t(block[4 * i]) << 24 | uint32_t(block[4 * i + 1]) << 16 | uint32_t(block[4 * i + 2]) << 8 |
+               uint32_t(block[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256Rounds[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+    state_[5] += f;
+    state_[6] += g;
+    state_[7] += h;
+}
+
+PdfCache::Key PdfCache::KeyBuilder::finish() {
+    uint64_t bits = totalSize_ * 8;
+    uint8_t padding[72] = {0x80};
+    size_t padSize = (blockSize_ < 56 ? 56 : 120) - blockSize_;
+    for (int i = 0; i < 8; ++i) padding[padSize + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    update(padding, padSize + 8);
+
+    Key key;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) key[4 * i + j] = static_cast<uint8_t>(state_[i] >> (24 - 8 * j));
+    }
+    return key;
+}
+
+// ---------------------------------------------------------------------------
+// PdfCache
+// ---------------------------------------------------------------------------
+
+size_t PdfCache::KeyHash::operator()(const Key& key) const {
+    // The key is already a uniform hash
+    size_t value;
+    std::memcpy(&value, key.data(), sizeof(value));
+    return value;
+}
+
+PdfCache::PdfCache(size_t maxMemoryBytes, const std::string& spillDirectory, uint64_t maxDiskBytes)
+    : maxMemoryBytes_(maxMemoryBytes), maxDiskBytes_(maxDiskBytes), spillDirectory_(spillDirectory) {
+    if (spillDirectory_.empty()) return;
+    std::error_code ec;
+    fs::create_directories(spillDirectory_, ec);
+    if (ec) {
+        LOG_WARN("PDF cache directory {} unavailable: {}", spillDirectory, ec.message());
+        spillDirectory_.clear();
+        return;
+    }
+    for (const auto& file : fs::directory_iterator(spillDirectory_, ec)) {
+        if (file.path().extension() == ".pdf") diskBytes_ += file.file_size(ec);
+    }
+    std::lock_guard<std::mutex> lock(diskMutex_);
+    trimDisk();
+}
+
+std::string PdfCache::toHex(const Key& key) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(key.size() * 2);
+    for (uint8_t byte : key) {
+        hex.push_back(digits[byte >> 4]);
+        hex.push_back(digits[byte & 15]);
+    }
+    return hex;
+}
+
+fs::path PdfCache::spillPath(const Key& key) const {
+    return spillDirectory_ / (toHex(key) + ".pdf");
+}
+
+PdfCache::Bytes PdfCache::find(const Key& key) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            entries_.splice(entries_.begin(), entries_, it->second);
+            ++hits_;
+            return it->second->pdf;
+        }
+    }
+    // Disk reads happen unlocked, so a slow read holds up no memory hits
+    Bytes pdf = loadSpilled(key);
+    std::vector<Entry> spills;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pdf) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        pdf = insert(key, std::move(pdf), spills);
+    }
+    spill(spills);
+    return pdf;
+}
+
+PdfCache::Bytes PdfCache::store(const Key& key, std::string pdf) {
+    std::vector<Entry> spills;
+    Bytes stored;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stored = insert(key, std::make_shared<const std::string>(std::move(pdf)), spills);
+    }
+    spill(spills);
+    return stored;
+}
+
+PdfCache::Bytes PdfCache::storeFile(const Key& key, const std::string& path) {
+    std::string pdf;
+    if (!readFile(path, pdf)) {
+        LOG_WARN("PDF cache could not read back {}", path);
+        return nullptr;
+    }
+    return store(key, std::move(pdf));
+}
+
+bool PdfCache::writeFile(const std::string& pdf, const std::string& path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(pdf.data(), static_cast<std::streamsize>(pdf.size()));
+    if (!file) {
+        LOG_ERROR("Failed to write cached PDF to {}", path);
+        return false;
+    }
+    LOG_INFO("PDF generated from cache: {}", path);
+    return true;
+}
+
+PdfCache::Bytes PdfCache::insert(const Key& key, Bytes pdf, std::vector<Entry>& spills) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        memoryBytes_ -= it->second->pdf->size();
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+    // A PDF larger than the whole budget is returned but not kept in memory
+    if (pdf->size() > maxMemoryBytes_) {
+        spills.push_back(Entry{key, pdf});
+        return pdf;
+    }
+    entries_.push_front(Entry{key, pdf});
+    index_[key] = entries_.begin();
+    memoryBytes_ += pdf->size();
+    evict(spills);
+    return pdf;
+}
+
+void PdfCache::evict(std::vector<Entry>& spills) {
+    while (memoryBytes_ > maxMemoryBytes_ && !entries_.empty()) {
+        Entry& oldest = entries_.back();
+        memoryBytes_ -= oldest.pdf->size();
+        index_.erase(oldest.key);
+        spills.push_back(std::move(oldest));
+        entries_.pop_back();
+    }
+}
+
+void PdfCache::spill(const std::vector<Entry>& spills) {
+    if (spillDirectory_.empty() || spills.empty()) return;
+    std::lock_guard<std::mutex> lock(diskMutex_);
+    bool wrote = false;
+    for (const Entry& entry : spills) {
+        if (entry.pdf->size() > maxDiskBytes_) continue;
+        fs::path path = spillPath(entry.key);
+        std::error_code ec;
+        if (fs::exists(path, ec)) continue;
+
+        // Write to a temporary name first so a reader never sees a partial file
+        fs::path temp = path;
+        temp += ".tmp";
+        {
+            std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+            file.write(entry.pdf->data(), static_cast<std::streamsize>(entry.pdf->size()));
+            if (!file) {
+                LOG_WARN("PDF cache could not write {}", temp.string());
+                fs::remove(temp, ec);
+                continue;
+            }
+        }
+        fs::rename(temp, path, ec);
+        if (ec) {
+            fs::remove(temp, ec);
+            continue;
+        }
+        diskBytes_ += entry.pdf->size();
+        wrote = true;
+    }
+    if (wrote) trimDisk();
+}
+
+PdfCache::Bytes PdfCache::loadSpilled(const Key& key) {
+    if (spillDirectory_.empty()) return nullptr;
+    fs::path path = spillPath(key);
+    std::string pdf;
+    if (!readFile(path, pdf)) return nullptr;
+    // Refresh the mtime so trimming treats it as recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return std::make_shared<const std::string>(std::move(pdf));
+}
+
+void PdfCache::trimDisk() {
+    if (diskBytes_ <= maxDiskBytes_) return;
+    struct SpilledFile {
+        fs::path path;
+        fs::file_time_type mtime;
+        uintmax_t size;
+    };
+    std::vector<SpilledFile> files;
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(spillDirectory_, ec)) {
+        if (file.path().extension() != ".pdf") continue;
+        files.push_back({file.path(), file.last_write_time(ec), file.file_size(ec)});
+    }
+    std::sort(files.begin(), files.end(), [](const SpilledFile& a, const SpilledFile& b) { return a.mtime < b.mtime; });
+
+    // Trim to 90% so the next few spills do not rescan the directory
+    uint64_t target = maxDiskBytes_ - maxDiskBytes_ / 10;
+    uint64_t total = 0;
+    for (const auto& file : files) total += file.size;
+    for (const auto& file : files) {
+        if (total <= target) break;
+        if (fs::remove(file.path, ec)) total -= file.size;
+    }
+    diskBytes_ = total;
+}
+
+void PdfCache::clear() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        index_.clear();
+        memoryBytes_ = 0;
+    }
+    if (spillDirectory_.empty()) return;
+    std::lock_guard<std::mutex> lock(diskMutex_);
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(spillDirectory_, ec)) {
+        if (file.path().extension() == ".pdf") fs::remove(file.path(), ec);
+    }
+    diskBytes_ = 0;
+}
+
+PdfCache::Stats PdfCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.memoryEntries = entries_.size();
+    stats.memoryBytes = memoryBytes_;
+    stats.diskBytes = diskBytes_;
+    return stats;
+}
+
+} // namespace htmlToPDF
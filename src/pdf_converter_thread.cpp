@@ -0,0 +1,218 @@
+#include "pdf_converter_thread.h"
+#include "image_generator.h"
+#include "pdf_metrics.h"
+#include "logging.hpp"
+
+namespace htmlToPDF {
+
+PdfConverterThread::PdfConverterThread(const PdfConfig& config, std::shared_ptr<PdfCache> cache)
+    : config_(config), cache_(std::move(cache)), head_(&stub_), tail_(&stub_) {
+    thread_ = std::thread([this] { run(); });
+}
+
+PdfConverterThread::~PdfConverterThread() {
+    {
+        // Under parkMutex_, so every request is either refused or already in pending_
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        stopping_ = true;
+        parked_ = false;
+    }
+    wakeup_.notify_one();
+    thread_.join();
+}
+
+PdfConverterThread& PdfConverterThread::shared() {
+    static PdfConverterThread converter;
+    return converter;
+}
+
+void PdfConverterThread::push(Node* node) {
+    node->next = nullptr;
+    Node* previous = head_.exchange(node);
+    previous->next = node;
+}
+
+PdfConverterThread::Job* PdfConverterThread::pop() {
+    Node* tail = tail_;
+    Node* next = tail->next;
+    if (tail == &stub_) {
+        if (next == nullptr) return nullptr;
+        tail_ = next;
+        tail = next;
+        next = next->next;
+    }
+    if (next != nullptr) {
+        tail_ = next;
+        return static_cast<Job*>(tail);
+    }
+    // A producer has swapped itself in but not linked yet; it is picked up next time
+    if (tail != head_.load()) return nullptr;
+    // tail is the last job: put the stub behind it so it can be taken
+    push(&stub_);
+    next = tail->next;
+    if (next != nullptr) {
+        tail_ = next;
+        return static_cast<Job*>(tail);
+    }
+    return nullptr;
+}
+
+void PdfConverterThread::run() {
+    // wkhtmltopdf belongs to the thread that initializes it
+    if (!PdfGenerator::initLibrary()) LOG_ERROR("PdfConverterThread: wkhtmltopdf failed to initialize");
+    ImageGenerator::initLibrary();
+    PdfGenerator generator(config_);
+    generator.setCache(cache_);
+
+    while (true) {
+        Job* job = pop();
+        if (job == nullptr) {
+            if (stopping_ && pending_ == 0) break;
+            // Re-check after announcing the park, so a push that missed it is still seen
+            std::unique_lock<std::mutex> lock(parkMutex_);
+            parked_ = true;
+            job = pop();
+            if (job == nullptr && !stopping_) wakeup_.wait(lock, [this] { return !parked_.load(); });
+            parked_ = false;
+            if (job == nullptr) continue;
+        }
+        --pending_;
+
+        std::unique_ptr<Job> owned(job);
+        const auto& request = owned->request;
+        if (PdfMetrics::enabled()) {
+            size_t documentBytes = request.html().size();
+            for (const auto& page : request.pages()) documentBytes += page.size();
+            PdfMetrics::shared().record(PdfMetrics::Stage::QueueWait, request.control.templateName, documentBytes,
+                                        std::chrono::steady_clock::now() - owned->postedAt);
+        }
+        PdfGenerateResult result = generator.execute(request);
+        if (owned->callback) {
+            try {
+                owned->callback(std::move(result));
+            } catch (const std::exception& e) {
+                LOG_ERROR("PdfConverterThread: completion callback threw: {}", e.what());
+            }
+        }
+    }
+
+    ImageGenerator::deinitLibrary();
+    PdfGenerator::deinitLibrary();
+}
+
+bool PdfConverterThread::generateAsync(PdfGenerateRequest request, CompletionCallback callback) {
+    // Time spent queued counts against the deadline
+    request.control.arm();
+    auto job = std::make_unique<Job>();
+    job->request = std::move(request);
+    job->callback = std::move(callback);
+    job->postedAt = std::chrono::steady_clock::now();
+    {
+        // Tested and counted together with the destructor's stopping_ = true, so the run
+        // loop cannot see pending_ == 0 and exit before this job is pushed. Refused rather
+        // than answered here, so callbacks only ever run on the converter thread.
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        if (stopping_) return false;
+        ++pending_;
+    }
+    push(job.release());
+    if (parked_) {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        parked_ = false;
+        wakeup_.notify_one();
+    }
+    return true;
+}
+
+std::future<PdfGenerateResult> PdfConverterThread::generateAsync(PdfGenerateRequest request) {
+    auto promise = std::make_shared<std::promise<PdfGenerateResult>>();
+    auto future = promise->get_future();
+    if (!generateAsync(std::move(request), [promise](PdfGenerateResult&& result) { promise->set_value(std::move(result)); })) {
+        PdfGenerateResult result;
+        result.errorMessage = "PDF converter thread is stopping";
+        promise->set_value(std::move(result));
+    }
+    return future;
+}
+
+PdfGenerateResult PdfConverterThread::execute(PdfGenerateRequest request) {
+    request.control.arm();
+    PdfJobControl job = request.control;
+    auto future = generateAsync(std::move(request));
+    if (job.deadline == std::chrono::steady_clock::time_point{} && !job.cancelToken) return future.get();
+
+    // The converter skips or discards the job too, so nothing is left running for it
+    while (future.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+        if (job.expired() || job.cancelled()) {
+            PdfGenerateResult result;
+            result.cancelled = job.cancelled();
+            result.timedOut = !result.cancelled;
+            result.errorMessage = result.cancelled ? "Cancelled" : "Timed out";
+            return result;
+        }
+    }
+    return future.get();
+}
+
+bool PdfConverterThread::generateFromHtml(std::string htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateFromHtml;
+    request.htmlContent = std::move(htmlContent);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    return execute(std::move(request)).success;
+}
+
+bool PdfConverterThread::generateFromHtml(std::shared_ptr<const std::string> htmlContent, const std::string& outputPath,
+                                          const PdfGenerator::PdfSettings& settings) {
+    if (!htmlContent) return false;
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateFromHtml;
+    request.sharedHtml = std::move(htmlContent);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    return execute(std::move(request)).success;
+}
+
+bool PdfConverterThread::generateMultiPagePdf(std::vector<std::string> htmlPages, const std::string& outputPath,
+                                              const PdfGenerator::PdfSettings& settings) {
+    if (htmlPages.empty()) return false;
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateMultiPage;
+    request.htmlPages = std::move(htmlPages);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    return execute(std::move(request)).success;
+}
+
+bool PdfConverterThread::generateMultiPagePdf(std::shared_ptr<const std::vector<std::string>> htmlPages, const std::string& outputPath,
+                                              const PdfGenerator::PdfSettings& settings) {
+    if (!htmlPages || htmlPages->empty()) return false;
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateMultiPage;
+    request.sharedPages = std::move(htmlPages);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    return execute(std::move(request)).success;
+}
+
+bool PdfConverterThread::generateToBuffer(std::string htmlContent, std::string& outputBuffer) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateToBuffer;
+    request.htmlContent = std::move(htmlContent);
+    auto result = execute(std::move(request));
+    if (result.success) outputBuffer = std::move(result.pdfData);
+    return result.success;
+}
+
+bool PdfConverterThread::generatePreview(std::string htmlContent, std::string& image, const ImageConfig& config) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GeneratePreview;
+    request.htmlContent = std::move(htmlContent);
+    request.imageConfig = config;
+    auto result = execute(std::move(request));
+    if (result.success) image = std::move(result.pdfData);
+    return result.success;
+}
+
+} // namespace htmlToPDF
@@ -1,23 +1,38 @@
+#if !defined(HTMLTOPDF_WITH_WX) || HTMLTOPDF_WITH_WX
 #include "wx/wxprec.h"
-#include <stdexcept>
 
 #ifndef WX_PRECOMP
 #include "wx/wx.h"
 #endif
+#endif
+#include <stdexcept>
 
 #include "pdf_generator.h"
+#include "pdf_metrics.h"
+#include "image_generator.h"
 #include <wkhtmltox/pdf.h>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <memory>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "logging.hpp"
-#include "global.h"
 #include "fmt/format.h"
+#if HTMLTOPDF_WITH_WX
+#include "global.h"
 wxDEFINE_EVENT(wpEVT_PDF_GENERATE, wxCommandEvent);
+#endif
 extern std::string GetVersionNo();
 
 namespace htmlToPDF {
 
+#if HTMLTOPDF_WITH_WX
 
 wxEvtHandler* PdfGeneratorProxy::eventHandler_ = nullptr;
 PdfGenerator PdfGeneratorProxy::generator_;
@@ -28,125 +43,266 @@ PdfGeneratorProxy::PdfGeneratorProxy(const PdfConfig& config) : config_(config)
 
 void PdfGeneratorProxy::SetEventHandler(wxEvtHandler* handler) {eventHandler_ = handler;}
 
+void PdfGeneratorProxy::SetCache(std::shared_ptr<PdfCache> cache) { generator_.setCache(std::move(cache)); }
+
 bool PdfGeneratorProxy::generateFromHtml(const std::string& htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    return generateFromHtml(std::string(htmlContent), outputPath, settings);
+}
+
+bool PdfGeneratorProxy::generateFromHtml(std::string&& htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
     PdfGenerateRequest request;
     request.type = PdfGenerateRequest::RequestType::GenerateFromHtml;
-    request.htmlContent = htmlContent;
+    request.htmlContent = std::move(htmlContent);
     request.outputPath = outputPath;
     request.settings = settings;
     
-    auto result = executeOnMainThread(request);
+    auto result = executeOnMainThread(std::move(request));
+    return result.success;
+}
+
+bool PdfGeneratorProxy::generateFromHtml(std::shared_ptr<const std::string> htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    if (!htmlContent) return false;
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateFromHtml;
+    request.sharedHtml = std::move(htmlContent);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    
+    auto result = executeOnMainThread(std::move(request));
     return result.success;
 }
 
 bool PdfGeneratorProxy::generateMultiPagePdf(const std::vector<std::string>& htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    return generateMultiPagePdf(std::vector<std::string>(htmlPages), outputPath, settings);
+}
+
+bool PdfGeneratorProxy::generateMultiPagePdf(std::vector<std::string>&& htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateMultiPage;
+    request.htmlPages = std::move(htmlPages);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    
+    auto result = executeOnMainThread(std::move(request));
+    return result.success;
+}
+
+bool PdfGeneratorProxy::generateMultiPagePdf(std::shared_ptr<const std::vector<std::string>> htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    if (!htmlPages) return false;
     PdfGenerateRequest request;
     request.type = PdfGenerateRequest::RequestType::GenerateMultiPage;
-    request.htmlPages = htmlPages;
+    request.sharedPages = std::move(htmlPages);
     request.outputPath = outputPath;
     request.settings = settings;
     
-    auto result = executeOnMainThread(request);
+    auto result = executeOnMainThread(std::move(request));
     return result.success;
 }
 
 bool PdfGeneratorProxy::generateToBuffer(const std::string& htmlContent, std::string& outputBuffer) {
+    return generateToBuffer(std::string(htmlContent), outputBuffer);
+}
+
+bool PdfGeneratorProxy::generateToBuffer(std::string&& htmlContent, std::string& outputBuffer) {
     PdfGenerateRequest request;
     request.type = PdfGenerateRequest::RequestType::GenerateToBuffer;
-    request.htmlContent = htmlContent;
-    request.outputBuffer = &outputBuffer;
+    request.htmlContent = std::move(htmlContent);
     
-    auto result = executeOnMainThread(request);
+    auto result = executeOnMainThread(std::move(request));
+    // Copied here rather than written by the main thread, which may outlive this call on shutdown
+    if (result.success) outputBuffer = std::move(result.pdfData);
+    return result.success;
+}
+
+bool PdfGeneratorProxy::generatePreview(std::string htmlContent, std::string& image, const ImageConfig& config) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GeneratePreview;
+    request.htmlContent = std::move(htmlContent);
+    request.imageConfig = config;
+
+    auto result = executeOnMainThread(std::move(request));
+    if (result.success) image = std::move(result.pdfData);
     return result.success;
 }
 
-using CallBackFunction = std::function<void(PdfGenerateResult&&)>;
+PdfGenerateResult PdfGeneratorProxy::execute(PdfGenerateRequest request) {
+    return executeOnMainThread(std::move(request));
+}
+
+std::future<PdfGenerateResult> PdfGeneratorProxy::generateAsync(PdfGenerateRequest request) {
+    auto promise = std::make_shared<std::promise<PdfGenerateResult>>();
+    auto future = promise->get_future();
+    generateAsync(std::move(request), [promise](PdfGenerateResult&& res) { promise->set_value(std::move(res)); });
+    return future;
+}
+
+void PdfGeneratorProxy::generateAsync(PdfGenerateRequest request, CompletionCallback callback) {
+    postToMainThread(std::move(request), std::move(callback));
+}
+
+std::future<PdfGenerateResult> PdfGeneratorProxy::generateFromHtmlAsync(std::string htmlContent, std::string outputPath, const PdfGenerator::PdfSettings& settings) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateFromHtml;
+    request.htmlContent = std::move(htmlContent);
+    request.outputPath = std::move(outputPath);
+    request.settings = settings;
+    return generateAsync(std::move(request));
+}
+
+std::future<PdfGenerateResult> PdfGeneratorProxy::generateMultiPagePdfAsync(std::vector<std::string> htmlPages, std::string outputPath, const PdfGenerator::PdfSettings& settings) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateMultiPage;
+    request.htmlPages = std::move(htmlPages);
+    request.outputPath = std::move(outputPath);
+    request.settings = settings;
+    return generateAsync(std::move(request));
+}
+
+std::future<PdfGenerateResult> PdfGeneratorProxy::generateToBufferAsync(std::string htmlContent) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateToBuffer;
+    request.htmlContent = std::move(htmlContent);
+    return generateAsync(std::move(request));
+}
+
 struct EventData {
     PdfGenerateRequest request;
-    CallBackFunction callback;
+    PdfGeneratorProxy::CompletionCallback callback;
+    std::chrono::steady_clock::time_point postedAt = std::chrono::steady_clock::now();
 };
 
-PdfGenerateResult PdfGeneratorProxy::executeOnMainThread(const PdfGenerateRequest& request) {
+void PdfGeneratorProxy::postToMainThread(PdfGenerateRequest&& request, CompletionCallback&& callback) {
     if (eventHandler_ == nullptr) {
         LOG_ERROR("PdfGeneratorProxy: Event handler not set");
-        return PdfGenerateResult{ false, "Event handler not set" };
+        if (callback) callback(PdfGenerateResult{ false, "Event handler not set" });
+        return;
     }
-    PdfGenerateResult result;
-    result.success = false;
 
-    LOG_INFO("PdfGeneratorProxy: executeOnMainThread called");
-   
-    // We're on a worker thread - send event to main thread and wait
-    std::mutex completionMutex;
-    std::condition_variable completionCV;
-    bool completed = false;
-  
-    EventData evData { request, [&completionMutex, &completionCV, &completed, &result](PdfGenerateResult &&res) {
-        LOG_INFO("PdfGeneratorProxy: PDF generation callback called");
-        std::lock_guard<std::mutex> lock(completionMutex);
-        result = std::move(res);
-        completed = true;
-        completionCV.notify_one();
-    }};
+    // Time spent waiting for the main thread counts against the deadline
+    request.control.arm();
+
+    // Heap-allocated and deleted by OnEvent, so it stays valid however long the
+    // main thread takes, even after a waiting caller has given up
+    auto* evData = new EventData{ std::move(request), std::move(callback) };
 
     wxCommandEvent event(wpEVT_PDF_GENERATE);
-    event.SetClientData(&evData);
+    event.SetClientData(evData);
 
-    // Send event to main thread
     LOG_INFO("PdfGeneratorProxy: Posting event to main thread");
     eventHandler_->QueueEvent(event.Clone());
+}
 
-    std::unique_lock<std::mutex> lock(completionMutex);
+PdfGenerateResult PdfGeneratorProxy::executeOnMainThread(PdfGenerateRequest&& request) {
+    LOG_INFO("PdfGeneratorProxy: executeOnMainThread called");
+
+    // Shared with the callback: if shutdown cuts the wait short, the main thread
+    // still completes into live state instead of this stack frame
+    struct Completion {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool completed = false;
+        PdfGenerateResult result;
+    };
+    auto completion = std::make_shared<Completion>();
+    request.control.arm();
+    PdfJobControl job = request.control;
+
+    postToMainThread(std::move(request), [completion](PdfGenerateResult&& res) {
+        LOG_INFO("PdfGeneratorProxy: PDF generation callback called");
+        std::lock_guard<std::mutex> lock(completion->mutex);
+        completion->result = std::move(res);
+        completion->completed = true;
+        completion->cv.notify_one();
+    });
+
+    std::unique_lock<std::mutex> lock(completion->mutex);
 
     // Wait for completion
     LOG_INFO("PdfGeneratorProxy: Waiting for PDF generation to complete");
-    completionCV.wait(lock, [&completed]() { return completed || global::g.isAppShuttingDown.load(); });
+    // Nothing signals the shutdown flag, so re-check it periodically
+    auto done = [&completion]() { return completion->completed || global::g.isAppShuttingDown.load(); };
+    while (!completion->cv.wait_for(lock, std::chrono::milliseconds(100), done)) {
+        // OnEvent skips or discards the job too, so nothing is left running for it
+        if (job.expired() || job.cancelled()) {
+            PdfGenerateResult result{ false, job.cancelled() ? "Cancelled" : "Timed out" };
+            result.cancelled = job.cancelled();
+            result.timedOut = !result.cancelled;
+            return result;
+        }
+    }
 
-    if (completed) LOG_INFO("PdfGeneratorProxy: PDF generation completed");
-    else LOG_ERROR("PdfGeneratorProxy: PDF generation interrupted due to shutdown");
-    return result;
+    if (!completion->completed) {
+        LOG_ERROR("PdfGeneratorProxy: PDF generation interrupted due to shutdown");
+        return PdfGenerateResult{ false, "Interrupted by application shutdown" };
+    }
+    LOG_INFO("PdfGeneratorProxy: PDF generation completed");
+    return std::move(completion->result);
 }
 
 void PdfGeneratorProxy::OnEvent(wxCommandEvent& event) {
     LOG_INFO("PdfGeneratorProxy: OnEvent called on main thread");
-    auto p = static_cast<EventData *>(event.GetClientData());
+    std::unique_ptr<EventData> p(static_cast<EventData *>(event.GetClientData()));
     if (p == nullptr) {
         LOG_ERROR("PdfGeneratorProxy: Invalid event client data");
         return;
     }
+    event.SetClientData(nullptr);
 
-    auto& request = p->request;
+    const auto& request = p->request;
     PdfGenerateResult result;
-   
+    if (PdfMetrics::enabled()) {
+        size_t documentBytes = request.html().size();
+        for (const auto& page : request.pages()) documentBytes += page.size();
+        PdfMetrics::shared().record(PdfMetrics::Stage::QueueWait, request.control.templateName, documentBytes,
+                                    std::chrono::steady_clock::now() - p->postedAt);
+    }
+    result = generator_.execute(request);
+    if (p->callback) p->callback(std::move(result));
+}
+
+#endif // HTMLTOPDF_WITH_WX
+
+PdfGenerateResult PdfGenerator::execute(const PdfGenerateRequest& request) {
+    PdfGenerateResult result;
+    setJobControl(request.control);
     try {
         switch (request.type) {
             case PdfGenerateRequest::RequestType::GenerateFromHtml:
-            LOG_INFO("PdfGeneratorProxy: Generating PDF from HTML");
-                result.success = generator_.generateFromHtml(request.htmlContent, request.outputPath, request.settings);
+                LOG_INFO("PdfGenerator: Generating PDF from HTML");
+                result.success = generateFromHtml(request.html(), request.outputPath, request.settings);
                 break;
-                
+
             case PdfGenerateRequest::RequestType::GenerateMultiPage:
-                LOG_INFO("PdfGeneratorProxy: Generating PDF from multiple HTML pages");
-                result.success = generator_.generateMultiPagePdf(request.htmlPages,request.outputPath,request.settings);
+                LOG_INFO("PdfGenerator: Generating PDF from multiple HTML pages");
+                result.success = generateMultiPagePdf(request.pages(), request.outputPath, request.settings);
                 break;
-                
+
             case PdfGenerateRequest::RequestType::GenerateToBuffer:
-                LOG_INFO("PdfGeneratorProxy: Generating PDF to memory buffer");
-                if (request.outputBuffer) {
-                    result.success = generator_.generateToBuffer(request.htmlContent, *const_cast<std::string*>(request.outputBuffer));
-                } else {
-                    result.success = false;
-                    result.errorMessage = "Output buffer is null";
-                }
+                LOG_INFO("PdfGenerator: Generating PDF to memory buffer");
+                result.success = generateToBuffer(request.html(), result.pdfData);
+                break;
+
+            case PdfGenerateRequest::RequestType::GeneratePreview: {
+                LOG_INFO("PdfGenerator: Generating preview image");
+                ImageGenerator images(request.imageConfig);
+                images.setCache(cache_);
+                images.setJobControl(request.control);
+                result.success = images.generateToBuffer(request.html(), result.pdfData);
                 break;
+            }
         }
     } catch (const std::exception& e) {
         result.success = false;
         result.errorMessage = e.what();
-        LOG_ERROR("PdfGeneratorProxy: Exception during PDF generation: {}", e.what());
+        LOG_ERROR("PdfGenerator: Exception during PDF generation: {}", e.what());
     }
-    auto completionCallBack = p->callback;
-    if (completionCallBack) completionCallBack(std::move(result));
+    setJobControl(PdfJobControl());
+    if (!result.success && (request.control.expired() || request.control.cancelled())) {
+        result.cancelled = request.control.cancelled();
+        result.timedOut = !result.cancelled;
+        result.errorMessage = result.cancelled ? "Cancelled" : "Timed out";
+    }
+    return result;
 }
 
 // Callback functions for wkhtmltopdf error/warning reporting
@@ -162,8 +318,161 @@ static void pdfWarningCallback(wkhtmltopdf_converter* /*converter*/, const char*
     }
 }
 
+const char* renderProfileName(RenderProfile profile) {
+    switch (profile) {
+        case RenderProfile::Fast: return "fast";
+        case RenderProfile::Balanced: return "balanced";
+        case RenderProfile::Quality: return "quality";
+        default: return "default";
+    }
+}
+
+// Helper: document-wide part of a RenderProfile; Default leaves wkhtmltopdf's own values
+static void applyProfile(wkhtmltopdf_global_settings* gs, RenderProfile profile) {
+    if (profile == RenderProfile::Default) return;
+    const char* imageDpi = profile == RenderProfile::Fast ? "96" : profile == RenderProfile::Balanced ? "150" : "300";
+    const char* imageQuality = profile == RenderProfile::Fast ? "60" : profile == RenderProfile::Balanced ? "85" : "94";
+    wkhtmltopdf_set_global_setting(gs, "outline", profile == RenderProfile::Quality ? "true" : "false");
+    wkhtmltopdf_set_global_setting(gs, "useCompression", "true");
+    wkhtmltopdf_set_global_setting(gs, "imageDPI", imageDpi);
+    wkhtmltopdf_set_global_setting(gs, "imageQuality", imageQuality);
+}
+
+// Helper: per-page part of a RenderProfile. Without JavaScript, inline event
+// handlers (onerror, onload) do not run. Smart shrinking stays on in every
+// profile: the templates are laid out for it and turning it off rescales pages.
+static void applyProfile(wkhtmltopdf_object_settings* os, RenderProfile profile) {
+    if (profile == RenderProfile::Default || profile == RenderProfile::Quality) return;
+    wkhtmltopdf_set_object_setting(os, "web.enableJavascript", "false");
+    wkhtmltopdf_set_object_setting(os, "load.jsdelay", "0");
+    wkhtmltopdf_set_object_setting(os, "web.enablePlugins", "false");
+}
+
+// The conversion running under PdfGenerator::mutex_, for the phase and progress callbacks
+static struct ActiveConversion {
+    const PdfJobControl* job = nullptr;
+    size_t documentBytes = 0;
+    bool timed = false;  // metrics were enabled when it started
+    int phase = -1;
+    std::chrono::steady_clock::time_point phaseStart;
+} active;
+
+// Helper: record how long the active conversion spent in the phase that just ended
+static void finishPhase(wkhtmltopdf_converter* converter) {
+    if (!active.timed || active.phase < 0) return;
+    const char* description = wkhtmltopdf_phase_description(converter, active.phase);
+    auto now = std::chrono::steady_clock::now();
+    PdfMetrics::shared().record(PdfMetrics::Stage::ConvertPhase, active.job->templateName, active.documentBytes,
+                                now - active.phaseStart, description ? description : "");
+    active.phaseStart = now;
+}
+
+// Helper: forward a progress update to the active job; exceptions must not cross wkhtmltopdf
+static void reportProgress(wkhtmltopdf_converter* converter, int percent) {
+    if (active.job == nullptr || !active.job->onProgress) return;
+    PdfProgress progress;
+    progress.phase = wkhtmltopdf_current_phase(converter);
+    progress.phaseCount = wkhtmltopdf_phase_count(converter);
+    const char* description = wkhtmltopdf_phase_description(converter, progress.phase);
+    progress.phaseDescription = description ? description : "";
+    progress.percent = percent;
+    try {
+        active.job->onProgress(progress);
+    } catch (const std::exception& e) {
+        LOG_ERROR("PDF progress callback threw: {}", e.what());
+    }
+}
+
+static void pdfPhaseCallback(wkhtmltopdf_converter* converter) {
+    finishPhase(converter);
+    active.phase = wkhtmltopdf_current_phase(converter);
+    reportProgress(converter, 0);
+}
+
+static void pdfProgressCallback(wkhtmltopdf_converter* converter, const int percent) {
+    reportProgress(converter, percent);
+}
+
+std::string PdfGenerator::documentLabel(const std::string& html) {
+    size_t begin = html.find("<title>");
+    if (begin != std::string::npos && begin < 4096) {
+        begin += 7;
+        size_t end = html.find("</title>", begin);
+        if (end != std::string::npos && end - begin <= 200) return "'" + html.substr(begin, end - begin) + "'";
+    }
+    return fmt::format("untitled, {} bytes", html.size());
+}
+
+void PdfJobControl::arm() {
+    if (timeout.count() > 0 && deadline == std::chrono::steady_clock::time_point{}) {
+        deadline = std::chrono::steady_clock::now() + timeout;
+    }
+}
+
+bool PdfJobControl::expired() const {
+    return deadline != std::chrono::steady_clock::time_point{} && std::chrono::steady_clock::now() >= deadline;
+}
+
 bool PdfGenerator::initialized_ = false;
-std::mutex PdfGenerator::mutex_;
+std::timed_mutex PdfGenerator::mutex_;
+std::atomic<size_t> PdfGenerator::timeouts_{0};
+std::atomic<size_t> PdfGenerator::cancellations_{0};
+
+bool PdfGenerator::abandonJob(const PdfJobControl& job, const char* stage, const std::string& htmlContent, size_t documentBytes) {
+    if (job.cancelled()) {
+        ++cancellations_;
+        PdfMetrics::shared().countDocument(PdfMetrics::Outcome::Cancelled, job.templateName, documentBytes);
+        LOG_WARN("PDF conversion of {} cancelled {}", documentLabel(htmlContent), stage);
+        return true;
+    }
+    if (job.expired()) {
+        ++timeouts_;
+        PdfMetrics::shared().countDocument(PdfMetrics::Outcome::TimedOut, job.templateName, documentBytes);
+        LOG_WARN("PDF conversion of {} exceeded its {} ms deadline {}", documentLabel(htmlContent), job.timeout.count(), stage);
+        return true;
+    }
+    return false;
+}
+
+bool PdfGenerator::lockForJob(std::unique_lock<std::timed_mutex>& lock, const PdfJobControl& job, const std::string& htmlContent,
+                              size_t documentBytes) {
+    PdfMetrics::Timer timer(PdfMetrics::Stage::LockWait, job.templateName, documentBytes);
+    lock = std::unique_lock<std::timed_mutex>(mutex_, std::defer_lock);
+    if (job.deadline == std::chrono::steady_clock::time_point{} && !job.cancelToken) {
+        lock.lock();
+        return true;
+    }
+    // Wake up now and then to notice cancellation; a hung conversion ahead keeps the lock
+    do {
+        if (abandonJob(job, "while queued", htmlContent, documentBytes)) return false;
+    } while (!lock.try_lock_for(std::chrono::milliseconds(50)));
+    return true;
+}
+
+bool PdfGenerator::convertForJob(wkhtmltopdf_converter* converter, const PdfJobControl& job, const std::string& htmlContent,
+                                 size_t documentBytes) {
+    active = ActiveConversion();
+    active.job = &job;
+    active.documentBytes = documentBytes;
+    active.timed = PdfMetrics::enabled();
+    if (job.onProgress || active.timed) {
+        wkhtmltopdf_set_phase_changed_callback(converter, pdfPhaseCallback);
+        wkhtmltopdf_set_progress_changed_callback(converter, pdfProgressCallback);
+    }
+    bool success;
+    {
+        PdfMetrics::Timer timer(PdfMetrics::Stage::Convert, job.templateName, documentBytes);
+        active.phaseStart = std::chrono::steady_clock::now();
+        success = (wkhtmltopdf_convert(converter) == 1);
+        finishPhase(converter);
+    }
+    active = ActiveConversion();
+    // wkhtmltopdf cannot be stopped part-way; a late or cancelled result is discarded
+    if (abandonJob(job, "during conversion", htmlContent, documentBytes)) return false;
+    PdfMetrics::shared().countDocument(success ? PdfMetrics::Outcome::Succeeded : PdfMetrics::Outcome::Failed,
+                                       job.templateName, documentBytes);
+    return success;
+}
 
 PdfGenerator::PdfGenerator() : config_() {}
 
@@ -191,18 +500,58 @@ void PdfGenerator::deinitLibrary() {
     }
 }
 
+PdfCache::Key PdfGenerator::cacheKey(const std::vector<std::string_view>& pages, const PdfConfig& config) {
+    PdfCache::KeyBuilder key;
+    key.add("config").add(config.pageSize).add(config.marginTop).add(config.marginBottom);
+    key.add(config.marginLeft).add(config.marginRight).add(config.enableLocalFileAccess ? 1 : 0);
+    key.add(static_cast<long long>(config.profile));
+    key.add(GetVersionNo()).add(static_cast<long long>(pages.size()));
+    for (std::string_view page : pages) key.add(page);
+    return key.finish();
+}
+
+PdfCache::Key PdfGenerator::cacheKey(const std::vector<std::string_view>& pages, const PdfSettings& settings) {
+    PdfCache::KeyBuilder key;
+    key.add("settings").add(settings.pageSize).add(settings.orientation).add(settings.marginTop);
+    key.add(settings.marginBottom).add(settings.marginLeft).add(settings.marginRight).add(settings.enableLocalFileAccess ? 1 : 0);
+    key.add(settings.pageOffset).add(settings.footerRight).add(static_cast<long long>(settings.profile));
+    key.add(GetVersionNo()).add(static_cast<long long>(pages.size()));
+    for (std::string_view page : pages) key.add(page);
+    return key.finish();
+}
+
 bool PdfGenerator::generate(const std::string& htmlContent, const std::string& outputPath) {
     return doConvert(htmlContent, outputPath, nullptr);
 }
 
 bool PdfGenerator::generateFromHtml(const std::string& htmlContent, const std::string& outputPath, const PdfSettings& settings) {
-    return doConvertWithSettings(htmlContent, outputPath, settings);
+    if (!cache_) return doConvertWithSettings(htmlContent, outputPath, settings);
+    
+    PdfCache::Key key = cacheKey({htmlContent}, settings);
+    if (auto pdf = cache_->find(key)) return PdfCache::writeFile(*pdf, outputPath);
+    if (!doConvertWithSettings(htmlContent, outputPath, settings)) return false;
+    cache_->storeFile(key, outputPath);
+    return true;
 }
 
 bool PdfGenerator::generateMultiPagePdf(const std::vector<std::string>& htmlPages, const std::string& outputPath, const PdfSettings& settings) {
     if (htmlPages.empty()) return false;
+    if (!cache_) return doConvertMultiPage(htmlPages, outputPath, settings);
     
-    std::lock_guard<std::mutex> lock(mutex_);
+    PdfCache::Key key = cacheKey(std::vector<std::string_view>(htmlPages.begin(), htmlPages.end()), settings);
+    if (auto pdf = cache_->find(key)) return PdfCache::writeFile(*pdf, outputPath);
+    if (!doConvertMultiPage(htmlPages, outputPath, settings)) return false;
+    cache_->storeFile(key, outputPath);
+    return true;
+}
+
+bool PdfGenerator::doConvertMultiPage(const std::vector<std::string>& htmlPages, const std::string& outputPath, const PdfSettings& settings) {
+    PdfJobControl job = control_;
+    job.arm();
+    std::unique_lock<std::timed_mutex> lock;
+    size_t documentBytes = 0;
+    for (const auto& html : htmlPages) documentBytes += html.size();
+    if (!lockForJob(lock, job, htmlPages.front(), documentBytes)) return false;
     
     if (!initialized_) {
         LOG_ERROR("wkhtmltopdf not initialized - call initLibrary() from main thread at startup");
@@ -218,6 +567,9 @@ bool PdfGenerator::generateMultiPagePdf(const std::vector<std::string>& htmlPage
     wkhtmltopdf_set_global_setting(gs, "out", outputPath.c_str());
     wkhtmltopdf_set_global_setting(gs, "size.pageSize", settings.pageSize.c_str());
     wkhtmltopdf_set_global_setting(gs, "orientation", settings.orientation.c_str());
+    if (settings.pageOffset != 0) {
+        wkhtmltopdf_set_global_setting(gs, "pageOffset", std::to_string(settings.pageOffset).c_str());
+    }
     
     std::string marginTop = std::to_string(settings.marginTop) + "mm";
     std::string marginBottom = std::to_string(settings.marginBottom) + "mm";
@@ -228,6 +580,7 @@ bool PdfGenerator::generateMultiPagePdf(const std::vector<std::string>& htmlPage
     wkhtmltopdf_set_global_setting(gs, "margin.bottom", marginBottom.c_str());
     wkhtmltopdf_set_global_setting(gs, "margin.left", marginLeft.c_str());
     wkhtmltopdf_set_global_setting(gs, "margin.right", marginRight.c_str());
+    applyProfile(gs, settings.profile);
     
     wkhtmltopdf_converter* converter = wkhtmltopdf_create_converter(gs);
     if (!converter) {
@@ -240,14 +593,15 @@ bool PdfGenerator::generateMultiPagePdf(const std::vector<std::string>& htmlPage
     
     for (const auto& html : htmlPages) {
         wkhtmltopdf_object_settings* os = wkhtmltopdf_create_object_settings();
-        wkhtmltopdf_set_object_setting(os, "load.blockLocalFileAccess", "false");
-        wkhtmltopdf_set_object_setting(os, "footer.right", "Page [page] of [toPage]");
+        wkhtmltopdf_set_object_setting(os, "load.blockLocalFileAccess", settings.enableLocalFileAccess ? "false" : "true");
+        wkhtmltopdf_set_object_setting(os, "footer.right", settings.footerRight.c_str());
         wkhtmltopdf_set_object_setting(os, "footer.left", fmt::format("ppos {}", GetVersionNo()).c_str());
         wkhtmltopdf_set_object_setting(os, "footer.fontSize", "4");
+        applyProfile(os, settings.profile);
         wkhtmltopdf_add_object(converter, os, html.c_str());
     }
     
-    bool success = (wkhtmltopdf_convert(converter) == 1);
+    bool success = convertForJob(converter, job, htmlPages.front(), documentBytes);
     
     if (!success) {
         LOG_ERROR("Multi-page PDF conversion failed");
@@ -275,19 +629,113 @@ bool PdfGenerator::generateToBuffer(const std::string& htmlContent, std::string&
     return doConvert(htmlContent, "", &outputBuffer);
 }
 
+PdfOutput PdfGenerator::generateToOutput(const std::string& htmlContent) {
+    PdfCache::Key key;
+    if (cache_) {
+        key = cacheKey({htmlContent}, config_);
+        if (auto pdf = cache_->find(key)) return PdfOutput(std::move(pdf));
+    }
+    
+    PdfJobControl job = control_;
+    job.arm();
+    PdfOutput output;
+    {
+        std::unique_lock<std::timed_mutex> lock;
+        if (!lockForJob(lock, job, htmlContent, htmlContent.size())) return output;
+        wkhtmltopdf_converter* converter = runConversion(htmlContent, "", job);
+        if (!converter) return output;
+        output = PdfOutput(converter);
+    }
+    // The cache needs its own copy; serve that one and let the converter go
+    if (cache_) output = PdfOutput(cache_->store(key, std::string(output.view())));
+    return output;
+}
+
+bool PdfGenerator::generateToSink(const std::string& htmlContent, const ChunkSink& sink, size_t chunkSize) {
+    PdfOutput output = generateToOutput(htmlContent);
+    if (!output) return false;
+    PdfMetrics::Timer timer(PdfMetrics::Stage::OutputWrite, control_.templateName, htmlContent.size());
+    if (chunkSize == 0) chunkSize = output.size();
+    for (size_t offset = 0; offset < output.size(); offset += chunkSize) {
+        size_t length = std::min(chunkSize, output.size() - offset);
+        if (!sink(output.data() + offset, length)) {
+            LOG_WARN("PDF output stopped by sink after {} of {} bytes", offset, output.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PdfGenerator::generateToFd(const std::string& htmlContent, int fd) {
+    return generateToSink(htmlContent, [fd](const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            int written = _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+            ssize_t written = write(fd, data, size);
+            if (written < 0 && errno == EINTR) continue;
+#endif
+            if (written <= 0) {
+                LOG_ERROR("Failed to write PDF to descriptor {}: {}", fd, std::strerror(errno));
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    });
+}
+
 bool PdfGenerator::doConvert(const std::string& htmlContent, const std::string& outputPath,
                               std::string* outputBuffer) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    PdfCache::Key key;
+    if (cache_) {
+        key = cacheKey({htmlContent}, config_);
+        if (auto pdf = cache_->find(key)) {
+            if (outputBuffer != nullptr) outputBuffer->assign(*pdf);
+            return outputPath.empty() || PdfCache::writeFile(*pdf, outputPath);
+        }
+    }
     
+    PdfJobControl job = control_;
+    job.arm();
+    {
+        std::unique_lock<std::timed_mutex> lock;
+        if (!lockForJob(lock, job, htmlContent, htmlContent.size())) return false;
+        
+        wkhtmltopdf_converter* converter = runConversion(htmlContent, outputPath, job);
+        if (!converter) return false;
+        
+        if (outputBuffer != nullptr) {
+            PdfMetrics::Timer timer(PdfMetrics::Stage::OutputWrite, job.templateName, htmlContent.size());
+            const unsigned char* data = nullptr;
+            long len = wkhtmltopdf_get_output(converter, &data);
+            if (len > 0 && data != nullptr) {
+                outputBuffer->assign(reinterpret_cast<const char*>(data), len);
+            }
+        }
+        
+        wkhtmltopdf_destroy_converter(converter);
+    }
+    
+    if (cache_) {
+        if (!outputPath.empty()) cache_->storeFile(key, outputPath);
+        else if (outputBuffer != nullptr) cache_->store(key, *outputBuffer);
+    }
+    return true;
+}
+
+wkhtmltopdf_converter* PdfGenerator::runConversion(const std::string& htmlContent, const std::string& outputPath,
+                                                   const PdfJobControl& job) {
     if (!initialized_) {
         LOG_ERROR("wkhtmltopdf not initialized - call initLibrary() from main thread at startup");
-        return false;
+        return nullptr;
     }
     
     wkhtmltopdf_global_settings* gs = wkhtmltopdf_create_global_settings();
     if (!gs) {
         LOG_ERROR("Failed to create global settings");
-        return false;
+        return nullptr;
     }
     
     if (!outputPath.empty()) {
@@ -299,24 +747,24 @@ bool PdfGenerator::doConvert(const std::string& htmlContent, const std::string&
     wkhtmltopdf_set_global_setting(gs, "margin.bottom", config_.marginBottom.c_str());
     wkhtmltopdf_set_global_setting(gs, "margin.left", config_.marginLeft.c_str());
     wkhtmltopdf_set_global_setting(gs, "margin.right", config_.marginRight.c_str());
+    applyProfile(gs, config_.profile);
     
     wkhtmltopdf_object_settings* os = wkhtmltopdf_create_object_settings();
     if (!os) {
         LOG_ERROR("Failed to create object settings");
-        return false;
+        return nullptr;
     }
     
-    if (config_.enableLocalFileAccess) {
-        wkhtmltopdf_set_object_setting(os, "load.blockLocalFileAccess", "false");
-    }
+    wkhtmltopdf_set_object_setting(os, "load.blockLocalFileAccess", config_.enableLocalFileAccess ? "false" : "true");
     wkhtmltopdf_set_object_setting(os, "footer.right", "Page [page] of [toPage]");
     wkhtmltopdf_set_object_setting(os, "footer.left", fmt::format("ppos {}", GetVersionNo()).c_str());
     wkhtmltopdf_set_object_setting(os, "footer.fontSize", "4");
+    applyProfile(os, config_.profile);
 
     wkhtmltopdf_converter* converter = wkhtmltopdf_create_converter(gs);
     if (!converter) {
         LOG_ERROR("Failed to create PDF converter");
-        return false;
+        return nullptr;
     }
     
     wkhtmltopdf_set_error_callback(converter, pdfErrorCallback);
@@ -324,30 +772,73 @@ bool PdfGenerator::doConvert(const std::string& htmlContent, const std::string&
     
     wkhtmltopdf_add_object(converter, os, htmlContent.c_str());
     
-    bool success = (wkhtmltopdf_convert(converter) == 1);
-    
-    if (success && outputBuffer != nullptr) {
-        const unsigned char* data = nullptr;
-        long len = wkhtmltopdf_get_output(converter, &data);
-        if (len > 0 && data != nullptr) {
-            outputBuffer->assign(reinterpret_cast<const char*>(data), len);
-        }
-    }
-    
-    if (!success) {
+    if (!convertForJob(converter, job, htmlContent, htmlContent.size())) {
         LOG_ERROR("PDF conversion failed");
-    } else if (!outputPath.empty()) {
+        wkhtmltopdf_destroy_converter(converter);
+        return nullptr;
+    }
+    if (!outputPath.empty()) {
         LOG_INFO("PDF generated: {}", outputPath);
     }
-    
+    return converter;
+}
+
+void PdfGenerator::destroyConverter(wkhtmltopdf_converter* converter) {
+    // wkhtmltopdf is not thread-safe, so this waits for any running conversion
+    std::lock_guard<std::timed_mutex> lock(mutex_);
     wkhtmltopdf_destroy_converter(converter);
-    
-    return success;
+}
+
+PdfOutput::PdfOutput(wkhtmltopdf_converter* converter) : converter_(converter) {
+    const unsigned char* data = nullptr;
+    long len = wkhtmltopdf_get_output(converter, &data);
+    if (len > 0 && data != nullptr) {
+        data_ = reinterpret_cast<const char*>(data);
+        size_ = static_cast<size_t>(len);
+    }
+}
+
+PdfOutput::PdfOutput(PdfCache::Bytes cached) : cached_(std::move(cached)) {
+    data_ = cached_->data();
+    size_ = cached_->size();
+}
+
+PdfOutput::PdfOutput(PdfOutput&& other) noexcept
+    : converter_(other.converter_), cached_(std::move(other.cached_)), data_(other.data_), size_(other.size_) {
+    other.converter_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+PdfOutput& PdfOutput::operator=(PdfOutput&& other) noexcept {
+    if (this != &other) {
+        reset();
+        std::swap(converter_, other.converter_);
+        std::swap(cached_, other.cached_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+    return *this;
+}
+
+PdfOutput::~PdfOutput() {
+    reset();
+}
+
+void PdfOutput::reset() {
+    if (converter_) PdfGenerator::destroyConverter(converter_);
+    converter_ = nullptr;
+    cached_.reset();
+    data_ = nullptr;
+    size_ = 0;
 }
 
 bool PdfGenerator::doConvertWithSettings(const std::string& htmlContent, const std::string& outputPath,
                                           const PdfSettings& settings) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    PdfJobControl job = control_;
+    job.arm();
+    std::unique_lock<std::timed_mutex> lock;
+    if (!lockForJob(lock, job, htmlContent, htmlContent.size())) return false;
     
     if (!initialized_) {
         LOG_ERROR("wkhtmltopdf not initialized - call initLibrary() from main thread at startup");
@@ -363,6 +854,9 @@ bool PdfGenerator::doConvertWithSettings(const std::string& htmlContent, const s
     wkhtmltopdf_set_global_setting(gs, "out", outputPath.c_str());
     wkhtmltopdf_set_global_setting(gs, "size.pageSize", settings.pageSize.c_str());
     wkhtmltopdf_set_global_setting(gs, "orientation", settings.orientation.c_str());
+    if (settings.pageOffset != 0) {
+        wkhtmltopdf_set_global_setting(gs, "pageOffset", std::to_string(settings.pageOffset).c_str());
+    }
     
     std::string marginTop = std::to_string(settings.marginTop) + "mm";
     std::string marginBottom = std::to_string(settings.marginBottom) + "mm";
@@ -373,16 +867,18 @@ bool PdfGenerator::doConvertWithSettings(const std::string& htmlContent, const s
     wkhtmltopdf_set_global_setting(gs, "margin.bottom", marginBottom.c_str());
     wkhtmltopdf_set_global_setting(gs, "margin.left", marginLeft.c_str());
     wkhtmltopdf_set_global_setting(gs, "margin.right", marginRight.c_str());
+    applyProfile(gs, settings.profile);
     
     wkhtmltopdf_object_settings* os = wkhtmltopdf_create_object_settings();
     if (!os) {
         LOG_ERROR("Failed to create object settings");
         return false;
     }
-    wkhtmltopdf_set_object_setting(os, "load.blockLocalFileAccess", "false");
-    wkhtmltopdf_set_object_setting(os, "footer.right", "Page [page] of [toPage]");
+    wkhtmltopdf_set_object_setting(os, "load.blockLocalFileAccess", settings.enableLocalFileAccess ? "false" : "true");
+    wkhtmltopdf_set_object_setting(os, "footer.right", settings.footerRight.c_str());
     wkhtmltopdf_set_object_setting(os, "footer.left", fmt::format("ppos {}", GetVersionNo()).c_str());
     wkhtmltopdf_set_object_setting(os, "footer.fontSize", "4");
+    applyProfile(os, settings.profile);
 
     wkhtmltopdf_converter* converter = wkhtmltopdf_create_converter(gs);
     if (!converter) {
@@ -395,7 +891,7 @@ bool PdfGenerator::doConvertWithSettings(const std::string& htmlContent, const s
     
     wkhtmltopdf_add_object(converter, os, htmlContent.c_str());
     
-    bool success = (wkhtmltopdf_convert(converter) == 1);
+    bool success = convertForJob(converter, job, htmlContent, htmlContent.size());
     
     if (!success) {
         LOG_ERROR("PDF conversion failed");
@@ -0,0 +1,285 @@
+#include "pdf_merger.h"
+#include "logging.hpp"
+#include "fmt/format.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <utility>
+
+namespace htmlToPDF {
+
+// Numbers of the objects finish() writes; parts are numbered after them
+static const uint32_t rootPagesObject = 1;
+static const uint32_t catalogObject = 2;
+
+// Helper: PDF whitespace
+static bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+}
+
+// Helper: whitespace or a character that ends a token
+static bool isDelimiter(char c) {
+    return isSpace(c) || std::string_view("()<>[]{}/%").find(c) != std::string_view::npos;
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static size_t skipSpace(std::string_view text, size_t pos) {
+    while (pos < text.size() && isSpace(text[pos])) ++pos;
+    return pos;
+}
+
+// Helper: unsigned integer at pos; pos is left after it, unchanged if there is none
+static bool readNumber(std::string_view text, size_t& pos, uint64_t& value) {
+    size_t end = pos;
+    value = 0;
+    while (end < text.size() && isDigit(text[end])) value = value * 10 + static_cast<uint64_t>(text[end++] - '0');
+    if (end == pos) return false;
+    pos = end;
+    return true;
+}
+
+// Helper: "N G R" at pos; pos is left after the R
+static bool readReference(std::string_view text, size_t& pos, uint64_t& number) {
+    size_t at = pos;
+    uint64_t generation;
+    if (!readNumber(text, at, number)) return false;
+    at = skipSpace(text, at);
+    if (!readNumber(text, at, generation)) return false;
+    at = skipSpace(text, at);
+    if (at >= text.size() || text[at] != 'R' || (at + 1 < text.size() && !isDelimiter(text[at + 1]))) return false;
+    pos = at + 1;
+    return true;
+}
+
+// Helper: position just after a dictionary key (e.g. "/Count") followed by a value, or npos
+static size_t findKey(std::string_view text, std::string_view key, size_t from = 0) {
+    for (size_t pos = text.find(key, from); pos != std::string_view::npos; pos = text.find(key, pos + 1)) {
+        size_t end = pos + key.size();
+        if (end < text.size() && isDelimiter(text[end])) return skipSpace(text, end);
+    }
+    return std::string_view::npos;
+}
+
+// Helper: object number referenced by key anywhere in text; 0 if none
+static uint64_t referenceOf(std::string_view text, std::string_view key) {
+    for (size_t pos = findKey(text, key); pos != std::string_view::npos; pos = findKey(text, key, pos)) {
+        uint64_t number;
+        if (readReference(text, pos, number)) return number;
+    }
+    return 0;
+}
+
+// Helper: end of the literal string starting at pos, which is '('
+static size_t skipLiteralString(std::string_view text, size_t pos) {
+    int depth = 0;
+    for (; pos < text.size(); ++pos) {
+        if (text[pos] == '\\') ++pos;
+        else if (text[pos] == '(') ++depth;
+        else if (text[pos] == ')' && --depth == 0) return pos + 1;
+    }
+    return text.size();
+}
+
+// Helper: copy an object body to out with every reference shifted by shift.
+// Strings and comments are copied as they are, and so is everything from the
+// stream keyword on, which is binary data.
+static void shiftReferences(std::string_view body, uint64_t shift, std::string& out) {
+    size_t pos = 0;
+    while (pos < body.size()) {
+        char c = body[pos];
+        bool tokenStart = pos == 0 || isDelimiter(body[pos - 1]);
+        size_t end = pos + 1;
+        if (c == '(') {
+            end = skipLiteralString(body, pos);
+        } else if (c == '<' && end < body.size() && body[end] == '<') {
+            end = pos + 2;
+        } else if (c == '<') {
+            end = std::min(body.find('>', pos), body.size() - 1) + 1;
+        } else if (c == '%') {
+            end = std::min(body.find_first_of("\r\n", pos), body.size());
+        } else if (isDigit(c) && tokenStart) {
+            uint64_t number;
+            size_t at = pos;
+            if (readReference(body, at, number)) {
+                out += fmt::format("{} 0 R", number + shift);
+                pos = at;
+                continue;
+            }
+            while (end < body.size() && isDigit(body[end])) ++end;
+        } else if (std::isalpha(static_cast<unsigned char>(c)) && tokenStart) {
+            while (end < body.size() && !isDelimiter(body[end])) ++end;
+            if (body.substr(pos, end - pos) == "stream") {
+                out.append(body.data() + pos, body.size() - pos);
+                return;
+            }
+        }
+        out.append(body.data() + pos, end - pos);
+        pos = end;
+    }
+}
+
+PdfMerger::PdfMerger(const std::string& outputPath)
+    : path_(outputPath), out_(outputPath, std::ios::binary | std::ios::trunc), offsets_(catalogObject + 1, 0) {
+    if (!out_) {
+        LOG_ERROR("Failed to create merged PDF {}", path_);
+        failed_ = true;
+        return;
+    }
+    write("%PDF-1.4\n%\xe2\xe3\xcf\xd3\n");
+}
+
+void PdfMerger::write(std::string_view data) {
+    out_.write(data.data(), static_cast<std::streamsize>(data.size()));
+    written_ += data.size();
+}
+
+bool PdfMerger::appendFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        LOG_ERROR("Failed to open PDF part {}", path);
+        return false;
+    }
+    std::string pdf((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return append(pdf);
+}
+
+bool PdfMerger::append(std::string_view pdf) {
+    if (failed_) return false;
+
+    // Cross-reference table: where each object of the part starts
+    size_t pos = pdf.rfind("startxref");
+    uint64_t xref = 0;
+    if (pos != std::string_view::npos) {
+        pos = skipSpace(pdf, pos + 9);
+        readNumber(pdf, pos, xref);
+    }
+    if (xref == 0 || xref >= pdf.size() || pdf.compare(xref, 4, "xref") != 0) {
+        LOG_ERROR("PDF part has no cross-reference table");
+        return false;
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> objects;  // offset, number
+    pos = skipSpace(pdf, xref + 4);
+    uint64_t first, count;
+    while (readNumber(pdf, pos, first)) {
+        pos = skipSpace(pdf, pos);
+        if (!readNumber(pdf, pos, count)) break;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t offset, generation;
+            pos = skipSpace(pdf, pos);
+            bool entry = readNumber(pdf, pos, offset);
+            pos = skipSpace(pdf, pos);
+            if (!entry || !readNumber(pdf, pos, generation)) {
+                LOG_ERROR("Malformed cross-reference table in PDF part");
+                return false;
+            }
+            pos = skipSpace(pdf, pos);
+            if (pos < pdf.size() && pdf[pos] == 'n' && offset < xref) objects.emplace_back(offset, first + i);
+            ++pos;
+        }
+        pos = skipSpace(pdf, pos);
+    }
+    std::string_view trailer = pdf.substr(pos);
+    if (trailer.compare(0, 7, "trailer") != 0 || findKey(trailer, "/Prev") != std::string_view::npos || objects.empty()) {
+        LOG_ERROR("Unsupported PDF part: incremental updates or missing trailer");
+        return false;
+    }
+    std::sort(objects.begin(), objects.end());
+
+    // Body of an object of the part by number
+    auto body = [&](uint64_t number) -> std::string_view {
+        auto it = std::find_if(objects.begin(), objects.end(), [number](const auto& o) { return o.second == number; });
+        if (it == objects.end()) return {};
+        uint64_t end = it + 1 == objects.end() ? xref : (it + 1)->first;
+        return pdf.substr(it->first, end - it->first);
+    };
+    uint64_t pageTree = referenceOf(body(referenceOf(trailer, "/Root")), "/Pages");
+    std::string_view pageTreeBody = body(pageTree);
+    size_t countAt = findKey(pageTreeBody, "/Count");
+    uint64_t pages = 0;
+    if (pageTree == 0 || countAt == std::string_view::npos || !readNumber(pageTreeBody, countAt, pages)) {
+        LOG_ERROR("PDF part has no page tree");
+        return false;
+    }
+
+    uint64_t shift = offsets_.size() - 1;
+    std::string out;
+    for (size_t i = 0; i < objects.size(); ++i) {
+        uint64_t end = i + 1 == objects.size() ? xref : objects[i + 1].first;
+        std::string_view object = pdf.substr(objects[i].first, end - objects[i].first);
+        size_t start = object.find("obj");
+        size_t stop = object.rfind("endobj");
+        if (start == std::string_view::npos || stop == std::string_view::npos || stop < start + 3) {
+            LOG_ERROR("Malformed object {} in PDF part", objects[i].second);
+            return false;
+        }
+        uint64_t number = objects[i].second + shift;
+        if (offsets_.size() <= number) offsets_.resize(number + 1, 0);
+        offsets_[number] = written_;
+
+        out = fmt::format("{} 0 obj", number);
+        size_t bodyStart = out.size();
+        shiftReferences(object.substr(start + 3, stop - start - 3), shift, out);
+        if (objects[i].second == pageTree) {
+            size_t dictionary = out.find("<<", bodyStart);
+            if (dictionary != std::string::npos) out.insert(dictionary + 2, fmt::format(" /Parent {} 0 R", rootPagesObject));
+        }
+        out += "endobj\n";
+        write(out);
+    }
+    // Objects numbered past the last one in use still belong to this part
+    uint64_t size = 0;
+    size_t sizeAt = findKey(trailer, "/Size");
+    if (sizeAt != std::string_view::npos && readNumber(trailer, sizeAt, size) && size > 0 && offsets_.size() < size + shift) {
+        offsets_.resize(size + shift, 0);
+    }
+
+    if (pageTrees_.empty()) {
+        uint64_t info = referenceOf(trailer, "/Info");
+        if (info != 0) infoObject_ = static_cast<uint32_t>(info + shift);
+    }
+    pageTrees_.push_back(static_cast<uint32_t>(pageTree + shift));
+    pageCount_ += static_cast<int>(pages);
+    if (!out_) {
+        LOG_ERROR("Failed to write merged PDF {}", path_);
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool PdfMerger::finish() {
+    if (failed_ || pageTrees_.empty()) {
+        LOG_ERROR("Merged PDF {} has no pages", path_);
+        return false;
+    }
+    std::string kids;
+    for (uint32_t tree : pageTrees_) kids += fmt::format("{} 0 R ", tree);
+    offsets_[rootPagesObject] = written_;
+    write(fmt::format("{} 0 obj\n<<\n/Type /Pages\n/Kids [{}]\n/Count {}\n>>\nendobj\n", rootPagesObject, kids, pageCount_));
+    offsets_[catalogObject] = written_;
+    write(fmt::format("{} 0 obj\n<<\n/Type /Catalog\n/Pages {} 0 R\n>>\nendobj\n", catalogObject, rootPagesObject));
+
+    uint64_t xref = written_;
+    std::string table = fmt::format("xref\n0 {}\n0000000000 65535 f \n", offsets_.size());
+    table.reserve(table.size() + offsets_.size() * 20);
+    for (size_t number = 1; number < offsets_.size(); ++number) {
+        if (offsets_[number] == 0) table += "0000000000 65535 f \n";
+        else table += fmt::format("{:010} 00000 n \n", offsets_[number]);
+    }
+    table += fmt::format("trailer\n<<\n/Size {}\n/Root {} 0 R\n", offsets_.size(), catalogObject);
+    if (infoObject_ != 0) table += fmt::format("/Info {} 0 R\n", infoObject_);
+    table += fmt::format(">>\nstartxref\n{}\n%%EOF\n", xref);
+    write(table);
+    out_.close();
+    if (!out_) {
+        LOG_ERROR("Failed to write merged PDF {}", path_);
+        return false;
+    }
+    LOG_INFO("Merged PDF generated: {} ({} pages from {} parts)", path_, pageCount_, pageTrees_.size());
+    return true;
+}
+
+} // namespace htmlToPDF
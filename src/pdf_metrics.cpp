@@ -0,0 +1,204 @@
+#include "pdf_metrics.h"
+#include "logging.hpp"
+#include "fmt/format.h"
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+namespace htmlToPDF {
+
+static const char* const stageNames[] = {
+    "build_context", "render", "queue_wait", "lock_wait", "convert", "convert_phase", "output_write",
+};
+static_assert(sizeof(stageNames) / sizeof(stageNames[0]) == static_cast<size_t>(PdfMetrics::Stage::Count),
+              "one name per stage");
+
+static const char* const outcomeNames[] = {"succeeded", "failed", "timed_out", "cancelled"};
+static_assert(sizeof(outcomeNames) / sizeof(outcomeNames[0]) == static_cast<size_t>(PdfMetrics::Outcome::Count),
+              "one name per outcome");
+
+// Separates the labels packed into a series key
+static const char keySeparator = '\x1f';
+
+// Helper: pack labels into a series key; an empty template is reported as "other"
+static std::string seriesKey(const char* first, std::string_view templateName, const char* size, std::string_view phase) {
+    std::string key(first);
+    key += keySeparator;
+    if (templateName.empty()) key += "other";
+    else key.append(templateName.data(), templateName.size());
+    key += keySeparator;
+    key += size;
+    key += keySeparator;
+    key.append(phase.data(), phase.size());
+    return key;
+}
+
+// Helper: unpack a series key into its four labels
+static std::array<std::string_view, 4> seriesLabels(const std::string& key) {
+    std::array<std::string_view, 4> labels;
+    std::string_view rest(key);
+    for (size_t i = 0; i < labels.size(); ++i) {
+        size_t end = rest.find(keySeparator);
+        labels[i] = rest.substr(0, end);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+    }
+    return labels;
+}
+
+// Helper: escape a Prometheus label value
+static std::string labelValue(std::string_view value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') escaped += '\\';
+        if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+int LatencyHistogram::bucketOf(uint64_t micros) {
+    if (micros < subBuckets) return static_cast<int>(micros);
+    int exponent = 63;
+    while ((micros >> exponent) == 0) --exponent;
+    int bucket = (exponent - 3) * subBuckets + static_cast<int>((micros >> (exponent - 4)) & (subBuckets - 1));
+    return bucket < bucketCount ? bucket : bucketCount - 1;
+}
+
+uint64_t LatencyHistogram::upperBound(int bucket) {
+    if (bucket < subBuckets) return static_cast<uint64_t>(bucket);
+    int exponent = bucket / subBuckets + 3;
+    uint64_t lower = static_cast<uint64_t>(subBuckets + bucket % subBuckets) << (exponent - 4);
+    return lower + (uint64_t(1) << (exponent - 4)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    buckets_[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total) + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < bucketCount; ++bucket) {
+        seen += buckets_[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) return upperBound(bucket);
+    }
+    return upperBound(bucketCount - 1);
+}
+
+std::atomic<bool> PdfMetrics::enabled_{false};
+
+PdfMetrics& PdfMetrics::shared() {
+    static PdfMetrics metrics;
+    return metrics;
+}
+
+const char* PdfMetrics::sizeClass(size_t documentBytes) {
+    if (documentBytes < (16u << 10)) return "lt16k";
+    if (documentBytes < (256u << 10)) return "lt256k";
+    if (documentBytes < (4u << 20)) return "lt4m";
+    return "ge4m";
+}
+
+void PdfMetrics::record(Stage stage, std::string_view templateName, size_t documentBytes,
+                        std::chrono::steady_clock::duration elapsed, std::string_view phase) {
+    if (!enabled()) return;
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    SeriesKey key = seriesKey(stageNames[static_cast<int>(stage)], templateName, sizeClass(documentBytes), phase);
+
+    std::shared_ptr<LatencyHistogram> histogram;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& slot = latencies_[key];
+        if (!slot) slot = std::make_shared<LatencyHistogram>();
+        histogram = slot;
+    }
+    histogram->record(micros > 0 ? static_cast<uint64_t>(micros) : 0);
+}
+
+void PdfMetrics::countDocument(Outcome outcome, std::string_view templateName, size_t documentBytes) {
+    if (!enabled()) return;
+    SeriesKey key = seriesKey(outcomeNames[static_cast<int>(outcome)], templateName, sizeClass(documentBytes), {});
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++documents_[key];
+}
+
+std::string PdfMetrics::prometheusText() const {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 1.0};
+    std::lock_guard<std::mutex> lock(mutex_);
+    fmt::memory_buffer out;
+
+    fmt::format_to(std::back_inserter(out),
+                   "# HELP htmltopdf_stage_seconds Time spent in each stage of the PDF pipeline.\n"
+                   "# TYPE htmltopdf_stage_seconds summary\n");
+    for (const auto& [key, histogram] : latencies_) {
+        auto labels = seriesLabels(key);
+        std::string common = fmt::format("stage=\"{}\",template=\"{}\",size=\"{}\"", labels[0], labelValue(labels[1]), labels[2]);
+        if (!labels[3].empty()) common += fmt::format(",phase=\"{}\"", labelValue(labels[3]));
+        for (double q : quantiles) {
+            fmt::format_to(std::back_inserter(out), "htmltopdf_stage_seconds{{{},quantile=\"{}\"}} {:.6f}\n",
+                           common, q, histogram->quantile(q) / 1e6);
+        }
+        fmt::format_to(std::back_inserter(out), "htmltopdf_stage_seconds_sum{{{}}} {:.6f}\n", common, histogram->sumMicros() / 1e6);
+        fmt::format_to(std::back_inserter(out), "htmltopdf_stage_seconds_count{{{}}} {}\n", common, histogram->count());
+    }
+
+    fmt::format_to(std::back_inserter(out),
+                   "# HELP htmltopdf_documents_total PDF conversions by outcome.\n"
+                   "# TYPE htmltopdf_documents_total counter\n");
+    for (const auto& [key, count] : documents_) {
+        auto labels = seriesLabels(key);
+        fmt::format_to(std::back_inserter(out), "htmltopdf_documents_total{{outcome=\"{}\",template=\"{}\",size=\"{}\"}} {}\n",
+                       labels[0], labelValue(labels[1]), labels[2], count);
+    }
+    return fmt::to_string(out);
+}
+
+bool PdfMetrics::writePrometheusFile(const std::string& path) const {
+    std::string text = prometheusText();
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(text.data(), static_cast<std::streamsize>(text.size()))) {
+            LOG_ERROR("Failed to write PDF metrics to {}", temporary);
+            return false;
+        }
+    }
+    // rename() replaces the target atomically on POSIX; Windows needs it gone first
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Failed to replace PDF metrics file {}", path);
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+void PdfMetrics::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    latencies_.clear();
+    documents_.clear();
+}
+
+PdfMetrics::Timer::Timer(Stage stage, std::string_view templateName, size_t documentBytes)
+    : stage_(stage), templateName_(templateName), documentBytes_(documentBytes), running_(PdfMetrics::enabled()) {
+    if (running_) start_ = std::chrono::steady_clock::now();
+}
+
+PdfMetrics::Timer::~Timer() {
+    if (running_) {
+        PdfMetrics::shared().record(stage_, templateName_, documentBytes_, std::chrono::steady_clock::now() - start_);
+    }
+}
+
+} // namespace htmlToPDF
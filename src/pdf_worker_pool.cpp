@@ -0,0 +1,767 @@
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+extern char** environ;
+#endif
+
+#include "pdf_worker_pool.h"
+#include "image_generator.h"
+#include "pdf_metrics.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include "logging.hpp"
+
+namespace htmlToPDF {
+
+namespace {
+
+#ifdef _WIN32
+using Handle = HANDLE;
+const Handle invalidHandle = INVALID_HANDLE_VALUE;
+#else
+using Handle = int;
+const Handle invalidHandle = -1;
+#endif
+
+// First byte of every message from a worker
+const uint8_t resultMessage = 0;
+const uint8_t progressMessage = 1;
+
+// Larger frames can only come from a corrupted stream
+const uint64_t maxMessageSize = uint64_t(1) << 32;
+
+bool writeAll(Handle handle, const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+        DWORD written = 0;
+        if (!WriteFile(handle, data, chunk, &written, nullptr) || written == 0) return false;
+#else
+#ifdef MSG_NOSIGNAL
+        // A dead worker must fail the write, not raise SIGPIPE in the host application
+        ssize_t written = send(handle, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == ENOTSOCK) written = write(handle, data, size);
+#else
+        ssize_t written = write(handle, data, size);
+#endif
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+#endif
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool readAll(Handle handle, char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+        DWORD got = 0;
+        if (!ReadFile(handle, data, chunk, &got, nullptr) || got == 0) return false;
+#else
+        ssize_t got = read(handle, data, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+#endif
+        data += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// Messages are an 8-byte little-endian length followed by the payload
+class MessageWriter {
+public:
+    MessageWriter() : data_(8, '\0') {}
+
+    void putU8(uint8_t value) { data_.push_back(static_cast<char>(value)); }
+
+    void putU32(uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) putU8(static_cast<uint8_t>(value >> shift));
+    }
+
+    void putString(const std::string& value) {
+        putU32(static_cast<uint32_t>(value.size()));
+        data_.append(value);
+    }
+
+    // trailing: bytes the caller will write after this message as part of its payload
+    const std::string& finish(size_t trailing = 0) {
+        uint64_t size = data_.size() - 8 + trailing;
+        for (int i = 0; i < 8; ++i) data_[i] = static_cast<char>(size >> (8 * i));
+        return data_;
+    }
+
+private:
+    std::string data_;
+};
+
+class MessageReader {
+public:
+    explicit MessageReader(const std::string& data) : data_(data) {}
+
+    uint8_t getU8() {
+        if (pos_ >= data_.size()) {
+            ok_ = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint32_t getU32() {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 32; shift += 8) value |= uint32_t(getU8()) << shift;
+        return value;
+    }
+
+    std::string getString() {
+        uint32_t size = getU32();
+        if (!ok_ || size > data_.size() - pos_) {
+            ok_ = false;
+            return {};
+        }
+        std::string value = data_.substr(pos_, size);
+        pos_ += size;
+        return value;
+    }
+
+    size_t position() const { return pos_; }
+
+    // True while every field read so far was present
+    bool valid() const { return ok_; }
+    // True if every field was present and nothing is left over
+    bool ok() const { return ok_ && pos_ == data_.size(); }
+
+private:
+    const std::string& data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+bool writeMessage(Handle handle, const std::string& framed) {
+    return writeAll(handle, framed.data(), framed.size());
+}
+
+bool readMessage(Handle handle, std::string& payload) {
+    unsigned char header[8];
+    if (!readAll(handle, reinterpret_cast<char*>(header), sizeof(header))) return false;
+    uint64_t size = 0;
+    for (int i = 0; i < 8; ++i) size |= uint64_t(header[i]) << (8 * i);
+    if (size > maxMessageSize) return false;
+    payload.resize(static_cast<size_t>(size));
+    return readAll(handle, payload.data(), payload.size());
+}
+
+std::string encodeRequest(const PdfGenerateRequest& request, const PdfConfig& config) {
+    MessageWriter writer;
+    writer.putU8(static_cast<uint8_t>(request.type));
+    writer.putString(config.pageSize);
+    writer.putString(config.marginTop);
+    writer.putString(config.marginBottom);
+    writer.putString(config.marginLeft);
+    writer.putString(config.marginRight);
+    writer.putU8(config.enableLocalFileAccess ? 1 : 0);
+    writer.putU8(static_cast<uint8_t>(config.profile));
+    writer.putString(request.settings.pageSize);
+    writer.putString(request.settings.orientation);
+    writer.putU32(static_cast<uint32_t>(request.settings.marginTop));
+    writer.putU32(static_cast<uint32_t>(request.settings.marginBottom));
+    writer.putU32(static_cast<uint32_t>(request.settings.marginLeft));
+    writer.putU32(static_cast<uint32_t>(request.settings.marginRight));
+    writer.putU8(request.settings.enableLocalFileAccess ? 1 : 0);
+    writer.putU32(static_cast<uint32_t>(request.settings.pageOffset));
+    writer.putString(request.settings.footerRight);
+    writer.putU8(static_cast<uint8_t>(request.settings.profile));
+    writer.putString(request.imageConfig.format);
+    writer.putU32(static_cast<uint32_t>(request.imageConfig.dpi));
+    writer.putU32(static_cast<uint32_t>(request.imageConfig.quality));
+    writer.putU32(static_cast<uint32_t>(request.imageConfig.page));
+    writer.putString(request.imageConfig.pageSize);
+    writer.putU8(request.imageConfig.landscape ? 1 : 0);
+    writer.putU8(request.imageConfig.enableLocalFileAccess ? 1 : 0);
+    writer.putString(request.html());
+    writer.putU32(static_cast<uint32_t>(request.pages().size()));
+    for (const auto& page : request.pages()) writer.putString(page);
+    writer.putString(request.outputPath);
+    writer.putU8(request.control.onProgress ? 1 : 0);
+    return writer.finish();
+}
+
+bool decodeRequest(const std::string& payload, PdfGenerateRequest& request, PdfConfig& config, bool& wantProgress) {
+    MessageReader reader(payload);
+    uint8_t type = reader.getU8();
+    if (type > static_cast<uint8_t>(PdfGenerateRequest::RequestType::GeneratePreview)) return false;
+    request.type = static_cast<PdfGenerateRequest::RequestType>(type);
+    config.pageSize = reader.getString();
+    config.marginTop = reader.getString();
+    config.marginBottom = reader.getString();
+    config.marginLeft = reader.getString();
+    config.marginRight = reader.getString();
+    config.enableLocalFileAccess = reader.getU8() != 0;
+    uint8_t configProfile = reader.getU8();
+    if (configProfile > static_cast<uint8_t>(RenderProfile::Quality)) return false;
+    config.profile = static_cast<RenderProfile>(configProfile);
+    request.settings.pageSize = reader.getString();
+    request.settings.orientation = reader.getString();
+    request.settings.marginTop = static_cast<int>(reader.getU32());
+    request.settings.marginBottom = static_cast<int>(reader.getU32());
+    request.settings.marginLeft = static_cast<int>(reader.getU32());
+    request.settings.marginRight = static_cast<int>(reader.getU32());
+    request.settings.enableLocalFileAccess = reader.getU8() != 0;
+    request.settings.pageOffset = static_cast<int>(reader.getU32());
+    request.settings.footerRight = reader.getString();
+    uint8_t settingsProfile = reader.getU8();
+    if (settingsProfile > static_cast<uint8_t>(RenderProfile::Quality)) return false;
+    request.settings.profile = static_cast<RenderProfile>(settingsProfile);
+    request.imageConfig.format = reader.getString();
+    request.imageConfig.dpi = static_cast<int>(reader.getU32());
+    request.imageConfig.quality = static_cast<int>(reader.getU32());
+    request.imageConfig.page = static_cast<int>(reader.getU32());
+    request.imageConfig.pageSize = reader.getString();
+    request.imageConfig.landscape = reader.getU8() != 0;
+    request.imageConfig.enableLocalFileAccess = reader.getU8() != 0;
+    request.htmlContent = reader.getString();
+    uint32_t pageCount = reader.getU32();
+    for (uint32_t i = 0; i < pageCount && reader.valid(); ++i) {
+        request.htmlPages.push_back(reader.getString());
+    }
+    request.outputPath = reader.getString();
+    wantProgress = reader.getU8() != 0;
+    return reader.ok();
+}
+
+// Header of a reply; the PDF bytes are written straight after it, not copied into the message
+std::string encodeResultHeader(const PdfGenerateResult& result, size_t pdfSize) {
+    MessageWriter writer;
+    writer.putU8(resultMessage);
+    writer.putU8(result.success ? 1 : 0);
+    writer.putString(result.errorMessage);
+    writer.putU32(static_cast<uint32_t>(pdfSize));
+    return writer.finish(pdfSize);
+}
+
+bool decodeResult(std::string& payload, PdfGenerateResult& result, std::string* pdf) {
+    MessageReader reader(payload);
+    if (reader.getU8() != resultMessage) return false;
+    result.success = reader.getU8() != 0;
+    result.errorMessage = reader.getString();
+    uint32_t pdfSize = reader.getU32();
+    if (!reader.valid() || pdfSize != payload.size() - reader.position()) return false;
+    if (pdf) {
+        // Reuse the reply's allocation for the PDF rather than copying it out
+        payload.erase(0, reader.position());
+        *pdf = std::move(payload);
+    }
+    return true;
+}
+
+std::string encodeProgress(const PdfProgress& progress) {
+    MessageWriter writer;
+    writer.putU8(progressMessage);
+    writer.putU32(static_cast<uint32_t>(progress.phase));
+    writer.putU32(static_cast<uint32_t>(progress.phaseCount));
+    writer.putString(progress.phaseDescription);
+    writer.putU32(static_cast<uint32_t>(progress.percent));
+    return writer.finish();
+}
+
+bool decodeProgress(const std::string& payload, PdfProgress& progress) {
+    MessageReader reader(payload);
+    reader.getU8();
+    progress.phase = static_cast<int>(reader.getU32());
+    progress.phaseCount = static_cast<int>(reader.getU32());
+    progress.phaseDescription = reader.getString();
+    progress.percent = static_cast<int>(reader.getU32());
+    return reader.ok();
+}
+
+// Wait until a reply can be read; false if the job expires or is cancelled first
+bool waitReadable(Handle handle, const PdfJobControl& job) {
+    if (job.deadline == std::chrono::steady_clock::time_point{} && !job.cancelToken) return true;
+    while (!job.expired() && !job.cancelled()) {
+#ifdef _WIN32
+        DWORD available = 0;
+        // A broken pipe counts as readable so the read reports it
+        if (!PeekNamedPipe(handle, nullptr, 0, nullptr, &available, nullptr) || available > 0) return true;
+        Sleep(10);
+#else
+        pollfd fd{handle, POLLIN, 0};
+        int ready = poll(&fd, 1, 50);
+        if (ready > 0 || (ready < 0 && errno != EINTR)) return true;
+#endif
+    }
+    return false;
+}
+
+// Worker side: the same dispatch PdfGeneratorProxy::OnEvent does on the main thread
+PdfGenerateResult convertRequest(const PdfGenerateRequest& request, const PdfConfig& config, PdfOutput& pdf) {
+    PdfGenerator generator(config);
+    generator.setJobControl(request.control);
+    PdfGenerateResult result;
+    try {
+        switch (request.type) {
+            case PdfGenerateRequest::RequestType::GenerateFromHtml:
+                result.success = generator.generateFromHtml(request.htmlContent, request.outputPath, request.settings);
+                break;
+            case PdfGenerateRequest::RequestType::GenerateMultiPage:
+                result.success = generator.generateMultiPagePdf(request.htmlPages, request.outputPath, request.settings);
+                break;
+            case PdfGenerateRequest::RequestType::GenerateToBuffer:
+                pdf = generator.generateToOutput(request.htmlContent);
+                result.success = static_cast<bool>(pdf);
+                break;
+            case PdfGenerateRequest::RequestType::GeneratePreview: {
+                ImageGenerator images(request.imageConfig);
+                images.setJobControl(request.control);
+                pdf = images.generateToOutput(request.htmlContent);
+                result.success = static_cast<bool>(pdf);
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.errorMessage = e.what();
+        LOG_ERROR("PdfWorkerPool: Exception during PDF generation: {}", e.what());
+    }
+    return result;
+}
+
+PdfCache::Key cacheKey(const PdfGenerateRequest& request, const PdfConfig& config) {
+    switch (request.type) {
+        case PdfGenerateRequest::RequestType::GenerateToBuffer:
+            return PdfGenerator::cacheKey({request.html()}, config);
+        case PdfGenerateRequest::RequestType::GeneratePreview:
+            return ImageGenerator::cacheKey(request.html(), request.imageConfig);
+        case PdfGenerateRequest::RequestType::GenerateMultiPage:
+            return PdfGenerator::cacheKey(std::vector<std::string_view>(request.pages().begin(), request.pages().end()),
+                                          request.settings);
+        case PdfGenerateRequest::RequestType::GenerateFromHtml:
+        default:
+            return PdfGenerator::cacheKey({request.html()}, request.settings);
+    }
+}
+
+// Non-owning pointer for a request that completes before the caller returns
+template <typename T>
+std::shared_ptr<const T> borrow(const T& value) {
+    return std::shared_ptr<const T>(&value, [](const T*) {});
+}
+
+// Path of the running executable, or empty if it cannot be determined
+std::string currentExecutable() {
+#if defined(_WIN32)
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) return {};
+    return std::string(path, length);
+#elif defined(__APPLE__)
+    char path[PATH_MAX];
+    uint32_t size = sizeof(path);
+    if (_NSGetExecutablePath(path, &size) != 0) return {};
+    return path;
+#else
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+    if (length <= 0 || static_cast<size_t>(length) == sizeof(path)) return {};
+    return std::string(path, static_cast<size_t>(length));
+#endif
+}
+
+} // namespace
+
+struct PdfWorkerPool::Worker {
+    size_t index = 0;
+    bool running = false;
+    size_t jobs = 0;
+    // Request and reply ends; one socket on POSIX, two pipes on Windows
+    Handle toWorker = invalidHandle;
+    Handle fromWorker = invalidHandle;
+#ifdef _WIN32
+    HANDLE process = nullptr;
+#else
+    pid_t pid = -1;
+#endif
+};
+
+PdfWorkerPool::PdfWorkerPool(unsigned workers, const std::string& executable)
+    : executable_(executable.empty() ? currentExecutable() : executable) {
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    if (executable_.empty()) LOG_ERROR("PdfWorkerPool: cannot determine the worker executable");
+    for (unsigned i = 0; i < workers; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->index = i;
+        idle_.push_back(worker.get());
+        workers_.push_back(std::move(worker));
+    }
+}
+
+PdfWorkerPool::~PdfWorkerPool() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& worker : workers_) stop(*worker);
+}
+
+void PdfWorkerPool::setMaxJobsPerWorker(size_t jobs) {
+    maxJobsPerWorker_ = jobs;
+}
+
+bool PdfWorkerPool::generateFromHtml(const std::string& htmlContent, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateFromHtml;
+    request.sharedHtml = borrow(htmlContent);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    return execute(request).success;
+}
+
+bool PdfWorkerPool::generateMultiPagePdf(const std::vector<std::string>& htmlPages, const std::string& outputPath, const PdfGenerator::PdfSettings& settings) {
+    if (htmlPages.empty()) return false;
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateMultiPage;
+    request.sharedPages = borrow(htmlPages);
+    request.outputPath = outputPath;
+    request.settings = settings;
+    return execute(request).success;
+}
+
+bool PdfWorkerPool::generateToBuffer(const std::string& htmlContent, std::string& outputBuffer, const PdfConfig& config) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GenerateToBuffer;
+    request.sharedHtml = borrow(htmlContent);
+    request.outputBuffer = &outputBuffer;
+    return execute(request, config).success;
+}
+
+bool PdfWorkerPool::generatePreview(const std::string& htmlContent, std::string& image, const ImageConfig& config) {
+    PdfGenerateRequest request;
+    request.type = PdfGenerateRequest::RequestType::GeneratePreview;
+    request.sharedHtml = borrow(htmlContent);
+    request.imageConfig = config;
+    request.outputBuffer = &image;
+    return execute(request).success;
+}
+
+PdfGenerateResult PdfWorkerPool::execute(const PdfGenerateRequest& request, const PdfConfig& config) {
+    bool toBuffer = request.type == PdfGenerateRequest::RequestType::GenerateToBuffer ||
+                    request.type == PdfGenerateRequest::RequestType::GeneratePreview;
+    if (toBuffer && request.outputBuffer == nullptr) {
+        return PdfGenerateResult{false, "Output buffer is null"};
+    }
+    PdfCache::Key key;
+    if (cache_) {
+        key = cacheKey(request, config);
+        if (auto pdf = cache_->find(key)) {
+            if (toBuffer) {
+                request.outputBuffer->assign(*pdf);
+                return PdfGenerateResult{true, ""};
+            }
+            return PdfGenerateResult{PdfCache::writeFile(*pdf, request.outputPath), ""};
+        }
+    }
+    PdfJobControl job = request.control;
+    job.arm();
+    std::string message = encodeRequest(request, config);
+    size_t documentBytes = request.html().size();
+    for (const auto& page : request.pages()) documentBytes += page.size();
+
+    Worker* worker;
+    {
+        PdfMetrics::Timer timer(PdfMetrics::Stage::QueueWait, job.templateName, documentBytes);
+        worker = acquire(job);
+    }
+    if (worker == nullptr) return abandon(job, "while queued", request);
+    if (!worker->running && !start(*worker)) {
+        release(worker);
+        return PdfGenerateResult{false, "PDF worker could not be started"};
+    }
+
+    PdfGenerateResult result;
+    std::string reply;
+    bool replied = false;
+    // Measured from here the round trip includes the worker's own lock and output write
+    PdfMetrics::Timer timer(PdfMetrics::Stage::Convert, job.templateName, documentBytes);
+    bool delivered = writeMessage(worker->toWorker, message);
+    while (delivered) {
+        if (!waitReadable(worker->fromWorker, job)) {
+            // Hung or no longer wanted: kill the worker so its slot is free again
+            stop(*worker, true);
+            release(worker);
+            return abandon(job, "during conversion", request);
+        }
+        if (!readMessage(worker->fromWorker, reply)) break;
+        PdfProgress progress;
+        if (!reply.empty() && static_cast<uint8_t>(reply[0]) == progressMessage) {
+            if (job.onProgress && decodeProgress(reply, progress)) job.onProgress(progress);
+            continue;
+        }
+        replied = true;
+        break;
+    }
+
+    if (!replied) {
+        // The worker died mid-conversion; only this request fails, the next one gets a fresh process
+        LOG_ERROR("PdfWorkerPool: worker {} exited during conversion", worker->index);
+        stop(*worker);
+        ++restarts_;
+        result.errorMessage = "PDF worker exited during conversion";
+    } else if (!decodeResult(reply, result, toBuffer ? request.outputBuffer : nullptr)) {
+        LOG_ERROR("PdfWorkerPool: malformed reply from worker {}", worker->index);
+        stop(*worker, true);
+        result = PdfGenerateResult{false, "Malformed reply from PDF worker"};
+    } else if (++worker->jobs == maxJobsPerWorker_) {
+        stop(*worker);
+    }
+    release(worker);
+    PdfMetrics::shared().countDocument(result.success ? PdfMetrics::Outcome::Succeeded : PdfMetrics::Outcome::Failed,
+                                       job.templateName, documentBytes);
+    if (cache_ && result.success) {
+        if (toBuffer) cache_->store(key, *request.outputBuffer);
+        else cache_->storeFile(key, request.outputPath);
+    }
+    return result;
+}
+
+PdfGenerateResult PdfWorkerPool::abandon(const PdfJobControl& job, const char* stage, const PdfGenerateRequest& request) {
+    PdfGenerateResult result;
+    std::string label = PdfGenerator::documentLabel(request.pages().empty() ? request.html() : request.pages().front());
+    size_t documentBytes = request.html().size();
+    for (const auto& page : request.pages()) documentBytes += page.size();
+    if (job.cancelled()) {
+        ++cancellations_;
+        PdfMetrics::shared().countDocument(PdfMetrics::Outcome::Cancelled, job.templateName, documentBytes);
+        result.cancelled = true;
+        result.errorMessage = "Cancelled";
+        LOG_WARN("PdfWorkerPool: conversion of {} cancelled {}", label, stage);
+    } else {
+        ++timeouts_;
+        PdfMetrics::shared().countDocument(PdfMetrics::Outcome::TimedOut, job.templateName, documentBytes);
+        result.timedOut = true;
+        result.errorMessage = "Timed out";
+        LOG_WARN("PdfWorkerPool: conversion of {} exceeded its {} ms deadline {}", label, job.timeout.count(), stage);
+    }
+    return result;
+}
+
+PdfWorkerPool::Worker* PdfWorkerPool::acquire(const PdfJobControl& job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto ready = [this] { return !idle_.empty(); };
+    if (job.deadline == std::chrono::steady_clock::time_point{} && !job.cancelToken) {
+        available_.wait(lock, ready);
+    } else {
+        // Wake up now and then to notice cancellation
+        while (!available_.wait_for(lock, std::chrono::milliseconds(50), ready)) {
+            if (job.expired() || job.cancelled()) return nullptr;
+        }
+        if (job.expired() || job.cancelled()) return nullptr;
+    }
+    Worker* worker = idle_.back();
+    idle_.pop_back();
+    return worker;
+}
+
+void PdfWorkerPool::release(Worker* worker) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(worker);
+    }
+    available_.notify_one();
+}
+
+bool PdfWorkerPool::isWorkerCommandLine(int argc, char* argv[]) {
+    return argc >= 2 && std::strcmp(argv[1], workerArgument) == 0;
+}
+
+#ifdef _WIN32
+
+bool PdfWorkerPool::start(Worker& worker) {
+    if (executable_.empty()) return false;
+    // Only the child's pipe ends may be inherited; serialize so concurrent
+    // starts do not hand each other's ends to the wrong process
+    static std::mutex spawnMutex;
+    std::lock_guard<std::mutex> lock(spawnMutex);
+
+    SECURITY_ATTRIBUTES inherit{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+    HANDLE childIn = INVALID_HANDLE_VALUE, toWorker = INVALID_HANDLE_VALUE;
+    HANDLE fromWorker = INVALID_HANDLE_VALUE, childOut = INVALID_HANDLE_VALUE;
+    if (!CreatePipe(&childIn, &toWorker, &inherit, 0)) return false;
+    if (!CreatePipe(&fromWorker, &childOut, &inherit, 0)) {
+        CloseHandle(childIn);
+        CloseHandle(toWorker);
+        return false;
+    }
+    SetHandleInformation(toWorker, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(fromWorker, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOA startup{};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = childIn;
+    startup.hStdOutput = childOut;
+    startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    std::string commandLine = "\"" + executable_ + "\" " + workerArgument;
+    PROCESS_INFORMATION info{};
+    BOOL created = CreateProcessA(executable_.c_str(), commandLine.data(), nullptr, nullptr, TRUE,
+                                  CREATE_NO_WINDOW, nullptr, nullptr, &startup, &info);
+    CloseHandle(childIn);
+    CloseHandle(childOut);
+    if (!created) {
+        LOG_ERROR("PdfWorkerPool: cannot start {} (error {})", executable_, GetLastError());
+        CloseHandle(toWorker);
+        CloseHandle(fromWorker);
+        return false;
+    }
+    CloseHandle(info.hThread);
+    worker.process = info.hProcess;
+    worker.toWorker = toWorker;
+    worker.fromWorker = fromWorker;
+    worker.running = true;
+    worker.jobs = 0;
+    return true;
+}
+
+void PdfWorkerPool::stop(Worker& worker, bool force) {
+    if (!worker.running) return;
+    if (force) TerminateProcess(worker.process, 1);
+    // Closing the request pipe ends an idle worker's read loop
+    CloseHandle(worker.toWorker);
+    CloseHandle(worker.fromWorker);
+    if (WaitForSingleObject(worker.process, 5000) != WAIT_OBJECT_0) {
+        TerminateProcess(worker.process, 1);
+        WaitForSingleObject(worker.process, INFINITE);
+    }
+    CloseHandle(worker.process);
+    worker.process = nullptr;
+    worker.toWorker = invalidHandle;
+    worker.fromWorker = invalidHandle;
+    worker.running = false;
+}
+
+#else
+
+bool PdfWorkerPool::start(Worker& worker) {
+    if (executable_.empty()) return false;
+    int fds[2];
+#ifdef SOCK_CLOEXEC
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) return false;
+#else
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    // The child's end becomes its stdin and stdout; dup2 clears close-on-exec on the copies
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+
+    std::string argument = workerArgument;
+    char* argv[] = {executable_.data(), argument.data(), nullptr};
+    pid_t pid = -1;
+    int error = posix_spawn(&pid, executable_.c_str(), &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (error != 0) {
+        LOG_ERROR("PdfWorkerPool: cannot start {}: {}", executable_, std::strerror(error));
+        close(fds[0]);
+        return false;
+    }
+    worker.pid = pid;
+    worker.toWorker = fds[0];
+    worker.fromWorker = fds[0];
+    worker.running = true;
+    worker.jobs = 0;
+    return true;
+}
+
+void PdfWorkerPool::stop(Worker& worker, bool force) {
+    if (!worker.running) return;
+    if (force) kill(worker.pid, SIGKILL);
+    // Closing the socket ends an idle worker's read loop; a hung one is killed
+    shutdown(worker.toWorker, SHUT_RDWR);
+    close(worker.toWorker);
+    int status = 0;
+    for (int waited = 0; waitpid(worker.pid, &status, WNOHANG) == 0; ++waited) {
+        if (waited == 500) {
+            kill(worker.pid, SIGKILL);
+            waitpid(worker.pid, &status, 0);
+            break;
+        }
+        usleep(10000);
+    }
+    if (WIFSIGNALED(status) && !force) {
+        LOG_WARN("PdfWorkerPool: worker {} was terminated by signal {}", worker.index, WTERMSIG(status));
+    }
+    worker.pid = -1;
+    worker.toWorker = invalidHandle;
+    worker.fromWorker = invalidHandle;
+    worker.running = false;
+}
+
+#endif
+
+int PdfWorkerPool::runWorker() {
+    // Keep stdin/stdout for the protocol and send anything else printed to stderr
+#ifdef _WIN32
+    Handle in = GetStdHandle(STD_INPUT_HANDLE);
+    Handle out = GetStdHandle(STD_OUTPUT_HANDLE);
+    SetStdHandle(STD_OUTPUT_HANDLE, GetStdHandle(STD_ERROR_HANDLE));
+    _dup2(2, 1);
+#else
+    Handle in = dup(0);
+    Handle out = dup(1);
+    dup2(2, 1);
+#endif
+
+    if (!PdfGenerator::initLibrary() || !ImageGenerator::initLibrary()) return 1;
+
+    std::string message;
+    while (readMessage(in, message)) {
+        PdfGenerateRequest request;
+        PdfConfig config;
+        bool wantProgress = false;
+        if (!decodeRequest(message, request, config, wantProgress)) {
+            LOG_ERROR("PdfWorkerPool: malformed request, worker exiting");
+            break;
+        }
+        if (wantProgress) {
+            // The pool enforces deadlines by killing this process; only progress travels back
+            request.control.onProgress = [out](const PdfProgress& progress) { writeMessage(out, encodeProgress(progress)); };
+        }
+        PdfOutput pdf;
+        PdfGenerateResult result = convertRequest(request, config, pdf);
+        if (!writeMessage(out, encodeResultHeader(result, pdf.size())) || !writeAll(out, pdf.data(), pdf.size())) break;
+    }
+
+    ImageGenerator::deinitLibrary();
+    PdfGenerator::deinitLibrary();
+    return 0;
+}
+
+} // namespace htmlToPDF
@@ -1,6 +1,4 @@
 #include "purchase_summary_builder.h"
-#include <sstream>
-#include <iomanip>
 #include <cstdio>
 
 std::string PurchaseSummaryPDFBuilder::colorToHex(unsigned char r, unsigned char g, unsigned char b) {
@@ -10,30 +8,7 @@ std::string PurchaseSummaryPDFBuilder::colorToHex(unsigned char r, unsigned char
 }
 
 std::string PurchaseSummaryPDFBuilder::formatNumber(double value, int decimals) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(decimals) << value;
-    std::string numStr = oss.str();
-    
-    // Add thousand separators
-    size_t dotPos = numStr.find('.');
-    std::string intPart = (dotPos != std::string::npos) ? numStr.substr(0, dotPos) : numStr;
-    std::string decPart = (dotPos != std::string::npos) ? numStr.substr(dotPos) : "";
-    
-    // Handle negative numbers
-    bool isNegative = (!intPart.empty() && intPart[0] == '-');
-    if (isNegative) intPart = intPart.substr(1);
-    
-    // Insert commas from right to left
-    std::string result;
-    int count = 0;
-    for (int i = static_cast<int>(intPart.length()) - 1; i >= 0; --i) {
-        if (count > 0 && count % 3 == 0) result = ',' + result;
-        result = intPart[i] + result;
-        ++count;
-    }
-    
-    if (isNegative) result = '-' + result;
-    return result + decPart;
+    return TemplateValue::number(value, decimals).str();
 }
 
 TemplateContext PurchaseSummaryPDFBuilder::buildContext(const SummaryData& data) {
@@ -67,35 +42,35 @@ TemplateContext PurchaseSummaryPDFBuilder::buildContext(const SummaryData& data)
     for (const auto& cat : data.categories) {
         Item item;
         item.fields["name"] = cat.name;
-        item.fields["gst"] = formatNumber(cat.gst);
-        item.fields["amount"] = formatNumber(cat.amount);
+        item.fields["gst"] = TemplateValue::number(cat.gst);
+        item.fields["amount"] = TemplateValue::number(cat.amount);
         ctx.lists["categories"].push_back(item);
     }
-    vars["total_category_gst"] = formatNumber(data.totalCategoryGst);
-    vars["total_category_amount"] = formatNumber(data.totalCategoryAmount);
+    vars["total_category_gst"] = TemplateValue::number(data.totalCategoryGst);
+    vars["total_category_amount"] = TemplateValue::number(data.totalCategoryAmount);
     
     // Payment types
     for (const auto& p : data.paymentTypes) {
         Item item;
         item.fields["name"] = p.name;
-        item.fields["amount"] = formatNumber(p.amount);
+        item.fields["amount"] = TemplateValue::number(p.amount);
         ctx.lists["payment_types"].push_back(item);
     }
-    vars["total_payment"] = formatNumber(data.totalPayment);
+    vars["total_payment"] = TemplateValue::number(data.totalPayment);
     
     // Return/cancelled
-    vars["return_cancelled"] = formatNumber(data.returnCancelled);
+    vars["return_cancelled"] = TemplateValue::number(data.returnCancelled);
     
     // Supplier data
     for (const auto& sup : data.suppliers) {
         Item item;
         item.fields["name"] = sup.name;
-        item.fields["gst"] = formatNumber(sup.gst);
-        item.fields["amount"] = formatNumber(sup.amount);
+        item.fields["gst"] = TemplateValue::number(sup.gst);
+        item.fields["amount"] = TemplateValue::number(sup.amount);
         ctx.lists["suppliers"].push_back(item);
     }
-    vars["total_supplier_gst"] = formatNumber(data.totalSupplierGst);
-    vars["total_supplier_amount"] = formatNumber(data.totalSupplierAmount);
+    vars["total_supplier_gst"] = TemplateValue::number(data.totalSupplierGst);
+    vars["total_supplier_amount"] = TemplateValue::number(data.totalSupplierAmount);
     
     return ctx;
 }
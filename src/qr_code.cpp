@@ -0,0 +1,446 @@
+#include "qr_code.h"
+#include "fmt/format.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+// Error correction codewords per block and number of blocks, by Ecc then version (index 0 unused)
+static const int8_t eccCodewordsPerBlock[4][41] = {
+    {-1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {-1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},
+    {-1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {-1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+};
+static const int8_t errorCorrectionBlocks[4][41] = {
+    {-1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},
+    {-1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},
+    {-1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},
+    {-1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},
+};
+
+// Format information bits for each Ecc, as the standard numbers them
+static const int eccFormatBits[4] = {1, 0, 3, 2};
+
+static const char alphanumericCharset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+enum class Mode { Numeric, Alphanumeric, Byte };
+
+// Helper: bits appended most significant first
+class BitBuffer {
+public:
+    void append(uint32_t value, int count) {
+        for (int i = count - 1; i >= 0; --i) bits_.push_back(static_cast<uint8_t>((value >> i) & 1));
+    }
+    size_t size() const { return bits_.size(); }
+    std::vector<uint8_t> bytes() const {
+        std::vector<uint8_t> result(bits_.size() / 8, 0);
+        for (size_t i = 0; i < result.size() * 8; ++i) result[i / 8] |= static_cast<uint8_t>(bits_[i] << (7 - i % 8));
+        return result;
+    }
+
+private:
+    std::vector<uint8_t> bits_;
+};
+
+// Helper: the most compact mode that can hold every character of text
+static Mode modeFor(std::string_view text) {
+    bool numeric = true;
+    bool alphanumeric = true;
+    for (char c : text) {
+        numeric = numeric && c >= '0' && c <= '9';
+        alphanumeric = alphanumeric && c != '\0' && std::strchr(alphanumericCharset, c) != nullptr;
+    }
+    if (numeric) return Mode::Numeric;
+    return alphanumeric ? Mode::Alphanumeric : Mode::Byte;
+}
+
+// Helper: width of the character count field
+static int countBits(Mode mode, int version) {
+    int range = version <= 9 ? 0 : version <= 26 ? 1 : 2;
+    static const int bits[3][3] = {{10, 12, 14}, {9, 11, 13}, {8, 16, 16}};
+    return bits[static_cast<int>(mode)][range];
+}
+
+// Helper: bits the text takes in mode, without header
+static size_t payloadBits(Mode mode, size_t length) {
+    switch (mode) {
+        case Mode::Numeric: return length / 3 * 10 + (length % 3 == 0 ? 0 : length % 3 == 1 ? 4 : 7);
+        case Mode::Alphanumeric: return length / 2 * 11 + (length % 2) * 6;
+        case Mode::Byte: break;
+    }
+    return length * 8;
+}
+
+// Helper: modules left for data and error correction once function patterns are drawn
+static int rawDataModules(int version) {
+    int result = (16 * version + 128) * version + 64;
+    if (version >= 2) {
+        int alignments = version / 7 + 2;
+        result -= (25 * alignments - 10) * alignments - 55;
+        if (version >= 7) result -= 36;
+    }
+    return result;
+}
+
+static int dataCodewords(int version, QrCode::Ecc ecc) {
+    int e = static_cast<int>(ecc);
+    return rawDataModules(version) / 8 - eccCodewordsPerBlock[e][version] * errorCorrectionBlocks[e][version];
+}
+
+// Helper: product in GF(2^8) modulo x^8 + x^4 + x^3 + x^2 + 1
+static uint8_t gfMultiply(uint8_t a, uint8_t b) {
+    int product = 0;
+    for (int i = 7; i >= 0; --i) {
+        product = (product << 1) ^ ((product >> 7) * 0x11D);
+        product ^= ((b >> i) & 1) * a;
+    }
+    return static_cast<uint8_t>(product);
+}
+
+// Helper: Reed-Solomon generator polynomial of the given degree, leading 1 omitted
+static std::vector<uint8_t> reedSolomonDivisor(int degree) {
+    std::vector<uint8_t> result(static_cast<size_t>(degree), 0);
+    result.back() = 1;
+    uint8_t root = 1;
+    for (int i = 0; i < degree; ++i) {
+        for (size_t j = 0; j < result.size(); ++j) {
+            result[j] = gfMultiply(result[j], root);
+            if (j + 1 < result.size()) result[j] ^= result[j + 1];
+        }
+        root = gfMultiply(root, 0x02);
+    }
+    return result;
+}
+
+static std::vector<uint8_t> reedSolomonRemainder(const uint8_t* data, size_t size, const std::vector<uint8_t>& divisor) {
+    std::vector<uint8_t> result(divisor.size(), 0);
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t factor = data[i] ^ result.front();
+        result.erase(result.begin());
+        result.push_back(0);
+        for (size_t j = 0; j < result.size(); ++j) result[j] ^= gfMultiply(divisor[j], factor);
+    }
+    return result;
+}
+
+// Helper: centre coordinates of the alignment patterns in each row and column
+static std::vector<int> alignmentPositions(int version) {
+    if (version == 1) return {};
+    int count = version / 7 + 2;
+    int step = version == 32 ? 26 : (version * 4 + count * 2 + 1) / (count * 2 - 2) * 2;
+    std::vector<int> result(static_cast<size_t>(count));
+    result[0] = 6;
+    for (int i = count - 1, pos = version * 4 + 10; i >= 1; --i, pos -= step) result[static_cast<size_t>(i)] = pos;
+    return result;
+}
+
+QrCode QrCode::encode(std::string_view text, Ecc ecc) {
+    Mode mode = modeFor(text);
+    QrCode qr;
+    int version = 1;
+    for (;; ++version) {
+        if (version > 40) return qr;
+        size_t needed = 4 + countBits(mode, version) + payloadBits(mode, text.size());
+        if (needed <= static_cast<size_t>(dataCodewords(version, ecc)) * 8) break;
+    }
+
+    BitBuffer bits;
+    static const uint32_t modeIndicator[] = {0x1, 0x2, 0x4};
+    bits.append(modeIndicator[static_cast<int>(mode)], 4);
+    bits.append(static_cast<uint32_t>(text.size()), countBits(mode, version));
+    switch (mode) {
+        case Mode::Numeric:
+            for (size_t i = 0; i < text.size(); i += 3) {
+                size_t n = std::min<size_t>(3, text.size() - i);
+                bits.append(static_cast<uint32_t>(std::strtoul(std::string(text.substr(i, n)).c_str(), nullptr, 10)),
+                            static_cast<int>(n * 3 + 1));
+            }
+            break;
+        case Mode::Alphanumeric:
+            for (size_t i = 0; i < text.size(); i += 2) {
+                uint32_t value = static_cast<uint32_t>(std::strchr(alphanumericCharset, text[i]) - alphanumericCharset);
+                if (i + 1 < text.size()) {
+                    value = value * 45 + static_cast<uint32_t>(std::strchr(alphanumericCharset, text[i + 1]) - alphanumericCharset);
+                    bits.append(value, 11);
+                } else {
+                    bits.append(value, 6);
+                }
+            }
+            break;
+        case Mode::Byte:
+            for (char c : text) bits.append(static_cast<uint8_t>(c), 8);
+            break;
+    }
+
+    // Terminator, byte alignment, then alternating pad bytes up to capacity
+    size_t capacity = static_cast<size_t>(dataCodewords(version, ecc)) * 8;
+    bits.append(0, static_cast<int>(std::min<size_t>(4, capacity - bits.size())));
+    bits.append(0, static_cast<int>((8 - bits.size() % 8) % 8));
+    for (uint32_t pad = 0xEC; bits.size() < capacity; pad ^= 0xEC ^ 0x11) bits.append(pad, 8);
+    std::vector<uint8_t> data = bits.bytes();
+
+    // Split into blocks, add error correction to each, and interleave
+    int e = static_cast<int>(ecc);
+    int blocks = errorCorrectionBlocks[e][version];
+    int eccLength = eccCodewordsPerBlock[e][version];
+    int rawCodewords = rawDataModules(version) / 8;
+    int shortBlocks = blocks - rawCodewords % blocks;
+    int shortDataLength = rawCodewords / blocks - eccLength;
+    std::vector<uint8_t> divisor = reedSolomonDivisor(eccLength);
+    std::vector<std::pair<size_t, size_t>> dataSpans;  // offset, length into data
+    std::vector<std::vector<uint8_t>> eccBlocks;
+    for (int i = 0, offset = 0; i < blocks; ++i) {
+        int length = shortDataLength + (i < shortBlocks ? 0 : 1);
+        dataSpans.emplace_back(static_cast<size_t>(offset), static_cast<size_t>(length));
+        eccBlocks.push_back(reedSolomonRemainder(data.data() + offset, static_cast<size_t>(length), divisor));
+        offset += length;
+    }
+    std::vector<uint8_t> codewords;
+    codewords.reserve(static_cast<size_t>(rawCodewords));
+    for (size_t i = 0; i <= static_cast<size_t>(shortDataLength); ++i) {
+        for (const auto& [offset, length] : dataSpans) {
+            if (i < length) codewords.push_back(data[offset + i]);
+        }
+    }
+    for (int i = 0; i < eccLength; ++i) {
+        for (const auto& block : eccBlocks) codewords.push_back(block[static_cast<size_t>(i)]);
+    }
+
+    qr.version_ = version;
+    qr.size_ = version * 4 + 17;
+    qr.ecc_ = ecc;
+    qr.modules_.assign(static_cast<size_t>(qr.size_) * qr.size_, 0);
+    qr.function_.assign(qr.modules_.size(), 0);
+    qr.drawFunctionPatterns();
+    qr.placeCodewords(codewords);
+
+    // Keep the mask with the lowest penalty; masks are their own inverse
+    long best = -1;
+    for (int mask = 0; mask < 8; ++mask) {
+        qr.applyMask(mask);
+        qr.drawFormatBits(mask);
+        long score = qr.penalty();
+        if (best < 0 || score < best) {
+            best = score;
+            qr.mask_ = mask;
+        }
+        qr.applyMask(mask);
+    }
+    qr.applyMask(qr.mask_);
+    qr.drawFormatBits(qr.mask_);
+    return qr;
+}
+
+void QrCode::set(int x, int y, bool dark, bool function) {
+    size_t index = static_cast<size_t>(y) * size_ + x;
+    modules_[index] = dark ? 1 : 0;
+    if (function) function_[index] = 1;
+}
+
+void QrCode::drawFunctionPatterns() {
+    for (int i = 0; i < size_; ++i) {
+        set(6, i, i % 2 == 0, true);
+        set(i, 6, i % 2 == 0, true);
+    }
+    drawFinder(3, 3);
+    drawFinder(size_ - 4, 3);
+    drawFinder(3, size_ - 4);
+
+    std::vector<int> positions = alignmentPositions(version_);
+    size_t count = positions.size();
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = 0; j < count; ++j) {
+            // Skip the three corners taken by finder patterns
+            bool corner = (i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0);
+            if (!corner) drawAlignment(positions[i], positions[j]);
+        }
+    }
+    // Reserve the format areas now; the real bits are drawn once the mask is known
+    drawFormatBits(0);
+    drawVersion();
+}
+
+void QrCode::drawFinder(int cx, int cy) {
+    for (int dy = -4; dy <= 4; ++dy) {
+        for (int dx = -4; dx <= 4; ++dx) {
+            int x = cx + dx, y = cy + dy;
+            if (x < 0 || x >= size_ || y < 0 || y >= size_) continue;
+            int distance = std::max(std::abs(dx), std::abs(dy));
+            set(x, y, distance != 2 && distance != 4, true);
+        }
+    }
+}
+
+void QrCode::drawAlignment(int cx, int cy) {
+    for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) set(cx + dx, cy + dy, std::max(std::abs(dx), std::abs(dy)) != 1, true);
+    }
+}
+
+void QrCode::drawFormatBits(int mask) {
+    int data = eccFormatBits[static_cast<int>(ecc_)] << 3 | mask;
+    int remainder = data;
+    for (int i = 0; i < 10; ++i) remainder = (remainder << 1) ^ ((remainder >> 9) * 0x537);
+    int bits = (data << 10 | remainder) ^ 0x5412;
+    auto bit = [bits](int i) { return ((bits >> i) & 1) != 0; };
+
+    // Around the top left finder
+    for (int i = 0; i <= 5; ++i) set(8, i, bit(i), true);
+    set(8, 7, bit(6), true);
+    set(8, 8, bit(7), true);
+    set(7, 8, bit(8), true);
+    for (int i = 9; i < 15; ++i) set(14 - i, 8, bit(i), true);
+
+    // Split between the other two finders
+    for (int i = 0; i < 8; ++i) set(size_ - 1 - i, 8, bit(i), true);
+    for (int i = 8; i < 15; ++i) set(8, size_ - 15 + i, bit(i), true);
+    set(8, size_ - 8, true, true);
+}
+
+void QrCode::drawVersion() {
+    if (version_ < 7) return;
+    int remainder = version_;
+    for (int i = 0; i < 12; ++i) remainder = (remainder << 1) ^ ((remainder >> 11) * 0x1F25);
+    long bits = static_cast<long>(version_) << 12 | remainder;
+    for (int i = 0; i < 18; ++i) {
+        bool dark = ((bits >> i) & 1) != 0;
+        int a = size_ - 11 + i % 3, b = i / 3;
+        set(a, b, dark, true);
+        set(b, a, dark, true);
+    }
+}
+
+void QrCode::placeCodewords(const std::vector<uint8_t>& codewords) {
+    size_t bit = 0;
+    size_t totalBits = codewords.size() * 8;
+    // Two-module columns from the right, alternately upwards and downwards, stepping over the timing column
+    for (int right = size_ - 1; right >= 1; right -= 2) {
+        if (right == 6) right = 5;
+        bool upward = ((right + 1) & 2) == 0;
+        for (int step = 0; step < size_; ++step) {
+            int y = upward ? size_ - 1 - step : step;
+            for (int j = 0; j < 2; ++j) {
+                int x = right - j;
+                size_t index = static_cast<size_t>(y) * size_ + x;
+                if (function_[index] || bit >= totalBits) continue;
+                modules_[index] = (codewords[bit / 8] >> (7 - bit % 8)) & 1;
+                ++bit;
+            }
+        }
+    }
+}
+
+void QrCode::applyMask(int mask) {
+    for (int y = 0; y < size_; ++y) {
+        for (int x = 0; x < size_; ++x) {
+            bool invert = false;
+            switch (mask) {
+                case 0: invert = (x + y) % 2 == 0; break;
+                case 1: invert = y % 2 == 0; break;
+                case 2: invert = x % 3 == 0; break;
+                case 3: invert = (x + y) % 3 == 0; break;
+                case 4: invert = (x / 3 + y / 2) % 2 == 0; break;
+                case 5: invert = x * y % 2 + x * y % 3 == 0; break;
+                case 6: invert = (x * y % 2 + x * y % 3) % 2 == 0; break;
+                case 7: invert = ((x + y) % 2 + x * y % 3) % 2 == 0; break;
+            }
+            size_t index = static_cast<size_t>(y) * size_ + x;
+            if (invert && !function_[index]) modules_[index] ^= 1;
+        }
+    }
+}
+
+long QrCode::penalty() const {
+    long result = 0;
+    auto at = [this](int x, int y) { return modules_[static_cast<size_t>(y) * size_ + x]; };
+
+    // Runs of five or more, and finder-like 1:1:3:1:1 patterns with four light modules beside them,
+    // along rows (transposed == false) and columns
+    for (int transposed = 0; transposed < 2; ++transposed) {
+        for (int line = 0; line < size_; ++line) {
+            auto cell = [&](int i) { return transposed ? at(line, i) : at(i, line); };
+            int run = 1;
+            for (int i = 1; i <= size_; ++i) {
+                if (i < size_ && cell(i) == cell(i - 1)) {
+                    ++run;
+                    continue;
+                }
+                if (run >= 5) result += 3 + (run - 5);
+                run = 1;
+            }
+            for (int i = 0; i + 7 <= size_; ++i) {
+                if (!(cell(i) && !cell(i + 1) && cell(i + 2) && cell(i + 3) && cell(i + 4) && !cell(i + 5) && cell(i + 6))) continue;
+                auto light = [&](int from, int to) {
+                    for (int k = from; k < to; ++k) {
+                        if (k >= 0 && k < size_ && cell(k)) return false;
+                    }
+                    return true;
+                };
+                if (light(i - 4, i)) result += 40;
+                if (light(i + 7, i + 11)) result += 40;
+            }
+        }
+    }
+
+    // 2x2 blocks of one colour
+    for (int y = 0; y + 1 < size_; ++y) {
+        for (int x = 0; x + 1 < size_; ++x) {
+            uint8_t c = at(x, y);
+            if (c == at(x + 1, y) && c == at(x, y + 1) && c == at(x + 1, y + 1)) result += 3;
+        }
+    }
+
+    // Distance of the dark share from 50%, in 5% steps
+    long total = static_cast<long>(size_) * size_;
+    long dark = std::count(modules_.begin(), modules_.end(), uint8_t(1));
+    long k = (std::labs(dark * 20 - total * 10) + total - 1) / total - 1;
+    result += k * 10;
+    return result;
+}
+
+std::string QrCode::toSvg(int border) const {
+    int extent = size_ + border * 2;
+    fmt::memory_buffer out;
+    fmt::format_to(std::back_inserter(out),
+                   "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 {0} {0}\" shape-rendering=\"crispEdges\">"
+                   "<rect width=\"{0}\" height=\"{0}\" fill=\"#fff\"/><path fill=\"#000\" d=\"",
+                   extent);
+    // One subpath per horizontal run of dark modules
+    for (int y = 0; y < size_; ++y) {
+        for (int x = 0; x < size_;) {
+            if (!dark(x, y)) {
+                ++x;
+                continue;
+            }
+            int start = x;
+            while (x < size_ && dark(x, y)) ++x;
+            fmt::format_to(std::back_inserter(out), "M{} {}h{}v1H{}z", start + border, y + border, x - start, start + border);
+        }
+    }
+    fmt::format_to(std::back_inserter(out), "\"/></svg>");
+    return fmt::to_string(out);
+}
+
+std::shared_ptr<const std::string> QrCode::svg(std::string_view text, Ecc ecc) {
+    // Each invoice has its own link, so this only needs to span the pages of one
+    // document and its reprints; cleared rather than evicted when it fills up
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const std::string>> cache;
+    std::string key = std::to_string(static_cast<int>(ecc)) + ':' + std::string(text);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) return it->second;
+    }
+
+    QrCode qr = encode(text, ecc);
+    if (qr.size() == 0) return nullptr;
+    auto svg = std::make_shared<const std::string>(qr.toSvg());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cache.size() >= 256) cache.clear();
+    cache.emplace(std::move(key), svg);
+    return svg;
+}
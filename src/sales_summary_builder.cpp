@@ -1,6 +1,4 @@
 #include "sales_summary_builder.h"
-#include <sstream>
-#include <iomanip>
 #include <cstdio>
 
 std::string SalesSummaryPDFBuilder::colorToHex(unsigned char r, unsigned char g, unsigned char b) {
@@ -10,30 +8,7 @@ std::string SalesSummaryPDFBuilder::colorToHex(unsigned char r, unsigned char g,
 }
 
 std::string SalesSummaryPDFBuilder::formatNumber(double value, int decimals) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(decimals) << value;
-    std::string numStr = oss.str();
-    
-    // Add thousand separators
-    size_t dotPos = numStr.find('.');
-    std::string intPart = (dotPos != std::string::npos) ? numStr.substr(0, dotPos) : numStr;
-    std::string decPart = (dotPos != std::string::npos) ? numStr.substr(dotPos) : "";
-    
-    // Handle negative numbers
-    bool isNegative = (!intPart.empty() && intPart[0] == '-');
-    if (isNegative) intPart = intPart.substr(1);
-    
-    // Insert commas from right to left
-    std::string result;
-    int count = 0;
-    for (int i = static_cast<int>(intPart.length()) - 1; i >= 0; --i) {
-        if (count > 0 && count % 3 == 0) result = ',' + result;
-        result = intPart[i] + result;
-        ++count;
-    }
-    
-    if (isNegative) result = '-' + result;
-    return result + decPart;
+    return TemplateValue::number(value, decimals).str();
 }
 
 TemplateContext SalesSummaryPDFBuilder::buildContext(const SummaryData& data) {
@@ -63,83 +38,83 @@ TemplateContext SalesSummaryPDFBuilder::buildContext(const SummaryData& data) {
     // Date range
     vars["from_date"] = data.fromDate;
     vars["to_date"] = data.toDate;
-    vars["num_receipts"] = std::to_string(data.numReceipts);
+    vars["num_receipts"] = data.numReceipts;
     
     // Shift info
-    vars["is_shift"] = data.shift.isShift ? "1" : "";
+    vars["is_shift"] = data.shift.isShift;
     vars["shift_id"] = data.shift.shiftId;
     vars["shift_terminal"] = data.shift.terminalName;
-    vars["starting_cash"] = formatNumber(data.shift.startingCash);
-    vars["closing_cash"] = formatNumber(data.shift.closingCash);
+    vars["starting_cash"] = TemplateValue::number(data.shift.startingCash);
+    vars["closing_cash"] = TemplateValue::number(data.shift.closingCash);
     
     // Flags
-    vars["show_category"] = data.showCategory ? "1" : "";
-    vars["show_by_date"] = data.showByDate ? "1" : "";
-    vars["is_cash_sales"] = data.isCashSales ? "1" : "";
-    vars["show_membership"] = data.showMembership ? "1" : "";
-    vars["show_by_customer"] = data.showByCustomer ? "1" : "";
+    vars["show_category"] = data.showCategory;
+    vars["show_by_date"] = data.showByDate;
+    vars["is_cash_sales"] = data.isCashSales;
+    vars["show_membership"] = data.showMembership;
+    vars["show_by_customer"] = data.showByCustomer;
     
     // Category data
     for (const auto& cat : data.categories) {
         Item item;
         item.fields["name"] = cat.name;
-        item.fields["amount"] = formatNumber(cat.amount);
+        item.fields["amount"] = TemplateValue::number(cat.amount);
         ctx.lists["categories"].push_back(item);
     }
-    vars["total_sales"] = formatNumber(data.totalSales);
+    vars["total_sales"] = TemplateValue::number(data.totalSales);
     
     // Date data
     for (const auto& d : data.dates) {
         Item item;
         item.fields["date"] = d.date;
-        item.fields["gst"] = formatNumber(d.gst);
-        item.fields["amount"] = formatNumber(d.amount);
-        item.fields["total"] = formatNumber(d.total);
+        item.fields["gst"] = TemplateValue::number(d.gst);
+        item.fields["amount"] = TemplateValue::number(d.amount);
+        item.fields["total"] = TemplateValue::number(d.total);
         ctx.lists["dates"].push_back(item);
     }
-    vars["dates_total_gst"] = formatNumber(data.datesTotalGst);
-    vars["dates_total_amount"] = formatNumber(data.datesTotalAmount);
-    vars["dates_total"] = formatNumber(data.datesTotal);
+    vars["dates_total_gst"] = TemplateValue::number(data.datesTotalGst);
+    vars["dates_total_amount"] = TemplateValue::number(data.datesTotalAmount);
+    vars["dates_total"] = TemplateValue::number(data.datesTotal);
     
     // Payment types
     for (const auto& p : data.paymentTypes) {
         Item item;
         item.fields["name"] = p.name;
-        item.fields["amount"] = formatNumber(p.amount);
+        item.fields["amount"] = TemplateValue::number(p.amount);
         ctx.lists["payment_types"].push_back(item);
     }
-    vars["total_discount_rounding"] = formatNumber(data.totalDiscountRounding);
-    vars["total_gst"] = formatNumber(data.totalGst);
+    vars["total_discount_rounding"] = TemplateValue::number(data.totalDiscountRounding);
+    vars["total_gst"] = TemplateValue::number(data.totalGst);
     
     // Cash outs
     for (const auto& c : data.cashOuts) {
         Item item;
         item.fields["name"] = c.name;
-        item.fields["amount"] = formatNumber(c.amount);
+        item.fields["amount"] = TemplateValue::number(c.amount);
         ctx.lists["cash_outs"].push_back(item);
     }
-    vars["total_cash_out"] = formatNumber(data.totalCashOut);
+    vars["total_cash_out"] = TemplateValue::number(data.totalCashOut);
     
     // Summary
-    vars["return_cancelled"] = formatNumber(data.returnCancelled);
-    vars["cash_in_drawer"] = formatNumber(data.cashInDrawer);
+    vars["return_cancelled"] = TemplateValue::number(data.returnCancelled);
+    vars["cash_in_drawer"] = TemplateValue::number(data.cashInDrawer);
     
     // Membership
-    vars["points_given"] = formatNumber(data.pointsGiven);
-    vars["points_reimbursed"] = formatNumber(data.pointsReimbursed);
+    vars["points_given"] = TemplateValue::number(data.pointsGiven);
+    vars["points_reimbursed"] = TemplateValue::number(data.pointsReimbursed);
     
     // Customer data
     for (const auto& cust : data.customers) {
         Item item;
         item.fields["name"] = cust.name;
-        item.fields["sales"] = formatNumber(cust.sales);
-        item.fields["cost"] = formatNumber(cust.cost);
-        item.fields["margin"] = formatNumber(cust.margin);
+        item.fields["sales"] = TemplateValue::number(cust.sales);
+        item.fields["cost"] = TemplateValue::number(cust.cost);
+        item.fields["margin"] = TemplateValue::number(cust.margin);
         ctx.lists["customers"].push_back(item);
     }
-    vars["customer_total_sales"] = formatNumber(data.customerTotalSales);
-    vars["customer_total_cost"] = formatNumber(data.customerTotalCost);
-    vars["customer_total_margin"] = formatNumber(data.customerTotalMargin);
+    vars["customer_total_sales"] = TemplateValue::number(data.customerTotalSales);
+    vars["customer_total_cost"] = TemplateValue::number(data.customerTotalCost);
+    vars["customer_total_margin"] = TemplateValue::number(data.customerTotalMargin);
     
     return ctx;
 }
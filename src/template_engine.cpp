@@ -1,226 +1,816 @@
 #include "template_engine.h"
+#include "template_scanner.h"
+#include "html_escape.h"
 #include "template_strings.h"  // Auto-generated from HTML templates
 #include <fstream>
 #include <sstream>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
 
-// Helper: find innermost {{#if varName}} block (no nested {{#if}} inside)
-static bool findInnermostIfBlock(const std::string& input, size_t& startPos, size_t& endPos,
-                                  std::string& varName, std::string& ifContent, std::string& elseContent) {
-    const std::string ifStart = "{{#if ";
-    const std::string ifEnd = "{{/if}}";
-    const std::string elseTag = "{{else}}";
-    
-    size_t searchFrom = 0;
-    while (true) {
-        size_t ifPos = input.find(ifStart, searchFrom);
-        if (ifPos == std::string::npos) return false;
-        
-        // Find the closing }} of {{#if varName}}
-        size_t varStart = ifPos + ifStart.length();
-        size_t closeTag = input.find("}}", varStart);
-        if (closeTag == std::string::npos) return false;
-        
-        // Extract variable name (trim whitespace)
-        std::string var = input.substr(varStart, closeTag - varStart);
-        size_t ws = var.find_first_of(" \t\n\r}");
-        if (ws != std::string::npos) var = var.substr(0, ws);
-        
-        size_t contentStart = closeTag + 2;
-        
-        // Find matching {{/if}} - but check for nested {{#if}} first
-        size_t endIfPos = input.find(ifEnd, contentStart);
-        if (endIfPos == std::string::npos) return false;
-        
-        // Check if there's a nested {{#if}} before this {{/if}}
-        size_t nestedIf = input.find(ifStart, contentStart);
-        if (nestedIf != std::string::npos && nestedIf < endIfPos) {
-            // There's a nested if, skip to process it first
-            searchFrom = nestedIf;
-            continue;
+// TemplateKeyRegistry storage. Names live in a deque so the string_view keys of
+// the lookup table stay valid as the registry grows.
+namespace {
+struct KeyTable {
+    std::shared_mutex mutex;
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, uint32_t> slots;
+};
+
+KeyTable& keyTable() {
+    static KeyTable table;
+    return table;
+}
+} // namespace
+
+uint32_t TemplateKeyRegistry::intern(std::string_view name) {
+    auto& table = keyTable();
+    {
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+        auto it = table.slots.find(name);
+        if (it != table.slots.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(table.mutex);
+    auto it = table.slots.find(name);
+    if (it != table.slots.end()) return it->second;
+    uint32_t slot = static_cast<uint32_t>(table.names.size());
+    table.names.emplace_back(name);
+    table.slots.emplace(table.names.back(), slot);
+    return slot;
+}
+
+uint32_t TemplateKeyRegistry::find(std::string_view name) {
+    auto& table = keyTable();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    auto it = table.slots.find(name);
+    return it != table.slots.end() ? it->second : TemplateKey::invalid;
+}
+
+std::string_view TemplateKeyRegistry::name(uint32_t slot) {
+    auto& table = keyTable();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    return slot < table.names.size() ? std::string_view(table.names[slot]) : std::string_view();
+}
+
+size_t TemplateKeyRegistry::size() {
+    auto& table = keyTable();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    return table.names.size();
+}
+
+TemplateKey::TemplateKey(std::string_view name) : slot(TemplateKeyRegistry::intern(name)) {}
+
+std::string_view TemplateKey::name() const {
+    return TemplateKeyRegistry::name(slot);
+}
+
+// Helper: "%.*f" formatting, then either thousand separators or trailing zeros
+// dropped - the same text the builders' formatNumber/formatQuantity produce
+static size_t formatFixed(double value, int decimals, bool grouped, char* out) {
+    char digits[400];
+    int written = std::snprintf(digits, sizeof(digits), "%.*f", decimals, value);
+    size_t len = written < 0 ? 0 : std::min(static_cast<size_t>(written), sizeof(digits) - 1);
+
+    if (!grouped) {
+        const char* dot = static_cast<const char*>(std::memchr(digits, '.', len));
+        if (dot != nullptr) {
+            size_t dotPos = static_cast<size_t>(dot - digits);
+            size_t last = len;
+            while (last > 0 && digits[last - 1] == '0') --last;
+            len = (last - 1 == dotPos) ? dotPos : last;
         }
-        
-        // This is an innermost block - check for {{else}}
-        size_t elsePos = input.find(elseTag, contentStart);
-        
-        startPos = ifPos;
-        endPos = endIfPos + ifEnd.length();
-        varName = var;
-        
-        // Check if {{else}} exists and is within this if block (before {{/if}})
-        if (elsePos != std::string::npos && elsePos < endIfPos) {
-            ifContent = input.substr(contentStart, elsePos - contentStart);
-            elseContent = input.substr(elsePos + elseTag.length(), endIfPos - (elsePos + elseTag.length()));
-        } else {
-            ifContent = input.substr(contentStart, endIfPos - contentStart);
-            elseContent = "";
+        std::memcpy(out, digits, len);
+        return len;
+    }
+
+    size_t intBegin = (len > 0 && digits[0] == '-') ? 1 : 0;
+    const char* dot = static_cast<const char*>(std::memchr(digits, '.', len));
+    size_t intEnd = dot ? static_cast<size_t>(dot - digits) : len;
+    size_t pos = 0;
+    if (intBegin) out[pos++] = '-';
+    for (size_t i = intBegin; i < intEnd; ++i) {
+        if (i > intBegin && (intEnd - i) % 3 == 0) out[pos++] = ',';
+        out[pos++] = digits[i];
+    }
+    std::memcpy(out + pos, digits + intEnd, len - intEnd);
+    return pos + len - intEnd;
+}
+
+TemplateValue TemplateValue::number(double value, int decimals) {
+    TemplateValue result;
+    result.type_ = Type::Number;
+    result.decimals_ = static_cast<int8_t>(std::clamp(decimals, 0, 9));
+    result.number_ = value;
+    return result;
+}
+
+TemplateValue TemplateValue::quantity(double value) {
+    TemplateValue result;
+    result.type_ = Type::Quantity;
+    result.decimals_ = 2;
+    result.number_ = value;
+    return result;
+}
+
+std::string_view TemplateValue::format(FormatBuffer& buffer) const {
+    switch (type_) {
+        case Type::String:
+            return text_;
+        case Type::Number:
+            return std::string_view(buffer, formatFixed(number_, decimals_, true, buffer));
+        case Type::Quantity:
+            return std::string_view(buffer, formatFixed(number_, decimals_, false, buffer));
+        case Type::Integer: {
+            int written = std::snprintf(buffer, sizeof(FormatBuffer), "%lld", integer_);
+            return std::string_view(buffer, written < 0 ? 0 : static_cast<size_t>(written));
         }
-        return true;
+        case Type::Bool:
+            return integer_ ? std::string_view("1") : std::string_view();
     }
+    return {};
 }
 
-// Helper: remove unmatched {{variable}} placeholders
-static std::string removeUnmatchedVariables(const std::string& input) {
-    std::string result;
-    result.reserve(input.size());
-    size_t pos = 0;
-    while (pos < input.size()) {
-        size_t start = input.find("{{", pos);
-        if (start == std::string::npos) {
-            result.append(input, pos, std::string::npos);
-            break;
+std::string TemplateValue::str() const {
+    FormatBuffer buffer;
+    return std::string(format(buffer));
+}
+
+bool TemplateValue::truthy() const {
+    switch (type_) {
+        case Type::Integer:
+        case Type::Bool:
+            return integer_ != 0;
+        default: {
+            FormatBuffer buffer;
+            std::string_view text = format(buffer);
+            return !text.empty() && text != "0" && text != "false";
         }
-        result.append(input, pos, start - pos);
-        
-        // Check if this is a control block (skip it)
-        if (start + 2 < input.size() && (input[start + 2] == '#' || input[start + 2] == '/')) {
-            result.append("{{");
-            pos = start + 2;
+    }
+}
+
+bool TemplateValue::operator==(const TemplateValue& other) const {
+    if (type_ != other.type_ || decimals_ != other.decimals_) return false;
+    switch (type_) {
+        case Type::String: return text_ == other.text_;
+        case Type::Number:
+        case Type::Quantity: return number_ == other.number_;
+        default: return integer_ == other.integer_;
+    }
+}
+
+// Helper: return [begin, end) of input with surrounding whitespace removed
+static std::string trimmedTag(const std::string& input, size_t begin, size_t end) {
+    while (begin < end && std::isspace(static_cast<unsigned char>(input[begin]))) ++begin;
+    while (end > begin && std::isspace(static_cast<unsigned char>(input[end - 1]))) --end;
+    return input.substr(begin, end - begin);
+}
+
+// Helper: if tag is "<keyword> <name>", store the first word of <name> and return true
+static bool matchBlockTag(const std::string& tag, const char* keyword, std::string& name) {
+    size_t len = std::strlen(keyword);
+    if (tag.compare(0, len, keyword) != 0 || tag.size() <= len ||
+        !std::isspace(static_cast<unsigned char>(tag[len]))) {
+        return false;
+    }
+    size_t start = tag.find_first_not_of(" \t\n\r", len);
+    if (start == std::string::npos) return false;
+    size_t end = tag.find_first_of(" \t\n\r", start);
+    name = tag.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    return true;
+}
+
+// Helper: append a span of the source as a text node, merging with a preceding adjacent span
+static void appendText(std::vector<CompiledTemplate::Node>& nodes, size_t offset, size_t length) {
+    if (length == 0) return;
+    if (!nodes.empty() && nodes.back().type == CompiledTemplate::Node::Type::Text &&
+        nodes.back().offset + nodes.back().length == offset) {
+        nodes.back().length += length;
+        return;
+    }
+    CompiledTemplate::Node node;
+    node.offset = offset;
+    node.length = length;
+    nodes.push_back(std::move(node));
+}
+
+CompiledTemplate TemplateEngine::compile(const std::string& templateStr) {
+    using Node = CompiledTemplate::Node;
+
+    // A block whose closing tag has not been seen yet
+    struct OpenBlock {
+        Node node;
+        bool inElse = false;
+        size_t tagOffset = 0;
+        size_t tagLength = 0;
+    };
+
+    CompiledTemplate compiled;
+    compiled.source_ = templateStr;
+    const std::string& src = compiled.source_;
+
+    std::vector<OpenBlock> open;
+    auto current = [&]() -> std::vector<Node>& {
+        if (open.empty()) return compiled.nodes_;
+        return open.back().inElse ? open.back().node.elseChildren : open.back().node.children;
+    };
+
+    size_t pos = 0;
+    for (const TemplateToken& token : TemplateScanner::tokenize(src)) {
+        appendText(current(), pos, token.begin - pos);
+        pos = token.end;
+
+        // Triple-brace {{{key}}} - unescaped variable
+        if (token.raw) {
+            Node node;
+            node.type = Node::Type::Variable;
+            node.name = trimmedTag(src, token.innerBegin(), token.innerEnd());
+            node.key = TemplateKey(node.name);
+            node.raw = true;
+            current().push_back(std::move(node));
             continue;
         }
-        
-        size_t end = input.find("}}", start + 2);
-        if (end == std::string::npos) {
-            result.append(input, start, std::string::npos);
-            break;
+
+        std::string tag = trimmedTag(src, token.innerBegin(), token.innerEnd());
+        std::string name;
+
+        if (matchBlockTag(tag, "#if", name) || matchBlockTag(tag, "#each", name)) {
+            OpenBlock block;
+            block.node.type = (tag[1] == 'i') ? Node::Type::If : Node::Type::Each;
+            block.node.name = name;
+            block.node.key = TemplateKey(name);
+            block.tagOffset = token.begin;
+            block.tagLength = token.end - token.begin;
+            open.push_back(std::move(block));
+        } else if (tag == "else") {
+            // Only meaningful directly inside {{#if}}; dropped elsewhere
+            if (!open.empty() && open.back().node.type == Node::Type::If && !open.back().inElse) {
+                open.back().inElse = true;
+            }
+        } else if ((tag == "/if" || tag == "/each") && !open.empty() &&
+                   open.back().node.type == (tag == "/if" ? Node::Type::If : Node::Type::Each)) {
+            Node node = std::move(open.back().node);
+            open.pop_back();
+            current().push_back(std::move(node));
+        } else if (!tag.empty() && (tag[0] == '#' || tag[0] == '/')) {
+            // Unknown or unbalanced control tag - keep it literally
+            appendText(current(), token.begin, token.end - token.begin);
+        } else {
+            Node node;
+            node.type = Node::Type::Variable;
+            node.name = tag;
+            node.key = TemplateKey(tag);
+            current().push_back(std::move(node));
         }
-        // Skip the unmatched variable (don't append it)
-        pos = end + 2;
     }
-    return result;
+    // Trailing text, including anything after an unterminated "{{"
+    appendText(current(), pos, src.size() - pos);
+
+    // Unclosed blocks: keep the opening tag literally and splice the contents into the parent
+    while (!open.empty()) {
+        OpenBlock block = std::move(open.back());
+        open.pop_back();
+        auto& parent = current();
+        appendText(parent, block.tagOffset, block.tagLength);
+        for (auto& child : block.node.children) parent.push_back(std::move(child));
+        for (auto& child : block.node.elseChildren) parent.push_back(std::move(child));
+    }
+
+    compiled.markFragments();
+    return compiled;
 }
 
-std::string TemplateEngine::render(const std::string& templateStr, const TemplateContext& context) {
-    std::string result = templateStr;
-    
-    // First process {{#if}} blocks (conditionals)
-    result = processIfBlocks(result, context.variables);
-    
-    // Then process {{#each}} blocks
-    result = processEachBlocks(result, context.lists);
-    
-    // Then replace all {{key}} patterns with values from context
-    for (const auto& [key, value] : context.variables) {
-        result = replaceVariable(result, key, value);
+// Helper: build nodes for ops [begin, end) of a generated table
+static void buildFromTable(const TemplateTable& table, const std::vector<TemplateKey>& keys,
+                           size_t begin, size_t end, std::vector<CompiledTemplate::Node>& nodes) {
+    using Node = CompiledTemplate::Node;
+    for (size_t i = begin; i < end; ++i) {
+        const TemplateOp& op = table.ops[i];
+        switch (op.code) {
+            case TemplateOp::Text:
+                appendText(nodes, op.value, op.length);
+                break;
+
+            case TemplateOp::Variable:
+            case TemplateOp::RawVariable: {
+                Node node;
+                node.type = Node::Type::Variable;
+                node.name = table.keys[op.value];
+                node.key = keys[op.value];
+                node.raw = (op.code == TemplateOp::RawVariable);
+                nodes.push_back(std::move(node));
+                break;
+            }
+
+            case TemplateOp::If:
+            case TemplateOp::Each: {
+                Node node;
+                node.type = (op.code == TemplateOp::If) ? Node::Type::If : Node::Type::Each;
+                node.name = table.keys[op.value];
+                node.key = keys[op.value];
+                size_t thenEnd = op.elseOp ? op.elseOp : op.endOp;
+                buildFromTable(table, keys, i + 1, thenEnd, node.children);
+                if (op.elseOp) buildFromTable(table, keys, op.elseOp + 1, op.endOp, node.elseChildren);
+                nodes.push_back(std::move(node));
+                i = op.endOp;
+                break;
+            }
+
+            case TemplateOp::Else:
+            case TemplateOp::End:
+                break;
+        }
     }
-    
-    // Remove any remaining unmatched variables (without regex)
-    result = removeUnmatchedVariables(result);
-    
-    return result;
 }
 
-std::string TemplateEngine::processIfBlocks(const std::string& input,
-                                             const std::map<std::string, std::string>& variables) {
-    std::string result = input;
-    
-    // Process innermost {{#if}} blocks iteratively until none remain
-    size_t startPos, endPos;
-    std::string varName, ifContent, elseContent;
-    
-    while (findInnermostIfBlock(result, startPos, endPos, varName, ifContent, elseContent)) {
-        std::string replacement;
-        
-        auto it = variables.find(varName);
-        // Condition is true if variable exists and is not empty, "0", or "false"
-        bool conditionTrue = (it != variables.end() && 
-                              !it->second.empty() && 
-                              it->second != "0" && 
-                              it->second != "false");
-        
-        if (conditionTrue) {
-            replacement = ifContent;
+CompiledTemplate TemplateEngine::compile(const TemplateTable& table) {
+    // Fall back to parsing if the generator could not tokenize the template, or if
+    // the compiler translated the literal differently (e.g. CRLF line endings)
+    if (table.opCount == 0 || std::strlen(table.source) != table.length) {
+        return compile(std::string(table.source));
+    }
+
+    std::vector<TemplateKey> keys;
+    keys.reserve(table.keyCount);
+    for (size_t i = 0; i < table.keyCount; ++i) {
+        keys.emplace_back(table.keys[i]);
+    }
+
+    CompiledTemplate compiled;
+    compiled.staticSource_ = table.source;
+    compiled.staticLength_ = table.length;
+    buildFromTable(table, keys, 0, table.opCount, compiled.nodes_);
+    compiled.markFragments();
+    return compiled;
+}
+
+// Helper: true if the subtree contains an {{#each}}
+static bool containsEach(const CompiledTemplate::Node& node) {
+    if (node.type == CompiledTemplate::Node::Type::Each) return true;
+    for (const auto& child : node.children) {
+        if (containsEach(child)) return true;
+    }
+    for (const auto& child : node.elseChildren) {
+        if (containsEach(child)) return true;
+    }
+    return false;
+}
+
+// Helper: add each key read in the subtree to deps, once
+static void collectDeps(const CompiledTemplate::Node& node, std::vector<TemplateKey>& deps) {
+    using Node = CompiledTemplate::Node;
+    if (node.type == Node::Type::Variable || node.type == Node::Type::If) {
+        bool seen = false;
+        for (TemplateKey key : deps) seen = seen || key.slot == node.key.slot;
+        if (!seen) deps.push_back(node.key);
+    }
+    for (const auto& child : node.children) collectDeps(child, deps);
+    for (const auto& child : node.elseChildren) collectDeps(child, deps);
+}
+
+// Helper: wrap maximal runs of text and loop-free {{#if}} blocks into Fragment
+// nodes. Runs without an {{#if}} are left alone - copying cached output would
+// cost as much as copying the text.
+static void groupFragments(std::vector<CompiledTemplate::Node>& nodes, uint32_t& nextFragment) {
+    using Node = CompiledTemplate::Node;
+    std::vector<Node> grouped;
+    grouped.reserve(nodes.size());
+    std::vector<Node> run;
+    bool runHasIf = false;
+
+    auto flush = [&]() {
+        if (runHasIf) {
+            Node fragment;
+            fragment.type = Node::Type::Fragment;
+            fragment.fragment = nextFragment++;
+            for (const auto& node : run) collectDeps(node, fragment.deps);
+            fragment.children = std::move(run);
+            grouped.push_back(std::move(fragment));
         } else {
-            replacement = elseContent;
+            for (auto& node : run) grouped.push_back(std::move(node));
+        }
+        run.clear();
+        runHasIf = false;
+    };
+
+    for (auto& node : nodes) {
+        bool isIf = node.type == Node::Type::If;
+        if (node.type == Node::Type::Text || (isIf && !containsEach(node))) {
+            runHasIf = runHasIf || isIf;
+            run.push_back(std::move(node));
+            continue;
         }
-        
-        result = result.substr(0, startPos) + replacement + result.substr(endPos);
+        flush();
+        // Variables and loops render live; an {{#if}} around a loop may still hold fragments
+        if (isIf) {
+            groupFragments(node.children, nextFragment);
+            groupFragments(node.elseChildren, nextFragment);
+        }
+        grouped.push_back(std::move(node));
     }
-    
-    return result;
+    flush();
+    nodes = std::move(grouped);
 }
 
-std::string TemplateEngine::loadTemplate(const std::string& path) {
-    std::ifstream file(path);
-    if (!file) {
-        return "";
+void CompiledTemplate::markFragments() {
+    uint32_t next = 0;
+    groupFragments(nodes_, next);
+    fragmentCount_ = next;
+}
+
+const std::string* TemplateFragmentCache::find(const CompiledTemplate& owner, uint32_t fragment,
+                                               const Values& values) {
+    bind(owner);
+    if (fragment < entries_.size()) {
+        const Entry& entry = entries_[fragment];
+        bool same = entry.filled && entry.values.size() == values.size();
+        for (size_t i = 0; same && i < values.size(); ++i) {
+            same = entry.present[i] == (values[i] != nullptr) && (values[i] == nullptr || *values[i] == entry.values[i]);
+        }
+        if (same) {
+            ++hits_;
+            return &entry.output;
+        }
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    ++misses_;
+    return nullptr;
 }
 
-std::string TemplateEngine::replaceVariable(const std::string& input,
-                                             const std::string& key,
-                                             const std::string& value) {
-    std::string result = input;
-    
-    // First replace triple-brace syntax {{{key}}} (unescaped in Mustache, same here)
-    std::string triplePlaceholder = "{{{" + key + "}}}";
-    size_t pos = 0;
-    while ((pos = result.find(triplePlaceholder, pos)) != std::string::npos) {
-        result.replace(pos, triplePlaceholder.length(), value);
-        pos += value.length();
+void TemplateFragmentCache::store(const CompiledTemplate& owner, uint32_t fragment, const Values& values,
+                                  std::string output) {
+    bind(owner);
+    if (fragment >= entries_.size()) return;
+    Entry& entry = entries_[fragment];
+    entry.filled = true;
+    entry.values.resize(values.size());
+    entry.present.resize(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        entry.present[i] = values[i] != nullptr;
+        entry.values[i] = values[i] ? *values[i] : TemplateValue();
     }
-    
-    // Then replace double-brace syntax {{key}}
-    std::string placeholder = "{{" + key + "}}";
-    pos = 0;
-    while ((pos = result.find(placeholder, pos)) != std::string::npos) {
-        result.replace(pos, placeholder.length(), value);
-        pos += value.length();
+    entry.output = std::move(output);
+}
+
+void TemplateFragmentCache::clear() {
+    owner_ = nullptr;
+    entries_.clear();
+    hits_ = 0;
+    misses_ = 0;
+}
+
+// Helper: a cache follows one template; switching templates starts it afresh
+void TemplateFragmentCache::bind(const CompiledTemplate& owner) {
+    if (owner_ == &owner) return;
+    owner_ = &owner;
+    entries_.assign(owner.fragmentCount(), Entry());
+}
+
+// Lookup chain used while rendering: the current {{#each}} item, then its enclosing scopes
+struct RenderScope {
+    const TemplateVariables& fields;
+    const TemplateLists& lists;
+    const RenderScope* parent;
+};
+
+static const TemplateValue* lookupValue(const RenderScope& scope, TemplateKey key) {
+    for (const RenderScope* s = &scope; s != nullptr; s = s->parent) {
+        if (const TemplateValue* value = s->fields.find(key)) return value;
     }
-    
-    return result;
+    return nullptr;
 }
 
-std::string TemplateEngine::processEachBlocks(const std::string& input,
-                                               const std::map<std::string, std::vector<Item>>& lists) {
-    std::string result = input;
-    
-    const std::string eachStart = "{{#each ";
-    const std::string eachEnd = "{{/each}}";
-    
-    size_t searchPos = 0;
-    while (true) {
-        size_t pos = result.find(eachStart, searchPos);
-        if (pos == std::string::npos) break;
-        
-        // Find the closing }} of {{#each listName}}
-        size_t varStart = pos + eachStart.length();
-        size_t closeTag = result.find("}}", varStart);
-        if (closeTag == std::string::npos) break;
-        
-        // Extract list name
-        std::string listName = result.substr(varStart, closeTag - varStart);
-        size_t ws = listName.find_first_of(" \t\n\r}");
-        if (ws != std::string::npos) listName = listName.substr(0, ws);
-        
-        size_t contentStart = closeTag + 2;
-        size_t endPos = result.find(eachEnd, contentStart);
-        if (endPos == std::string::npos) break;
-        
-        std::string blockContent = result.substr(contentStart, endPos - contentStart);
-        std::string replacement;
-        
-        auto it = lists.find(listName);
-        if (it != lists.end()) {
-            for (const auto& item : it->second) {
-                std::string itemContent = blockContent;
-                // Process {{#if}} blocks within the item context first
-                itemContent = processIfBlocks(itemContent, item.fields);
-                // Then replace variables
-                for (const auto& [key, value] : item.fields) {
-                    itemContent = replaceVariable(itemContent, key, value);
+static const std::vector<Item>* lookupList(const RenderScope& scope, TemplateKey key) {
+    for (const RenderScope* s = &scope; s != nullptr; s = s->parent) {
+        if (const std::vector<Item>* items = s->lists.find(key)) return items;
+    }
+    return nullptr;
+}
+
+// Condition is true if variable exists and is not empty, "0", or "false"
+static bool isTruthy(const TemplateValue* value) {
+    return value != nullptr && value->truthy();
+}
+
+// Output sinks for renderNodes(); each provides append(data, size)
+struct StringSink {
+    std::string& out;
+    void append(const char* data, size_t size) { out.append(data, size); }
+};
+
+struct MemoryBufferSink {
+    fmt::memory_buffer& out;
+    void append(const char* data, size_t size) { out.append(data, data + size); }
+};
+
+// Batches small appends so the writer sees a few large chunks instead of one call per node
+struct WriterSink {
+    static constexpr size_t kChunkSize = 8192;
+
+    explicit WriterSink(const CompiledTemplate::Writer& w) : writer(w) {}
+
+    const CompiledTemplate::Writer& writer;
+    char buffer[kChunkSize];
+    size_t used = 0;
+
+    void append(const char* data, size_t size) {
+        if (used + size > kChunkSize) {
+            flush();
+            if (size >= kChunkSize) {
+                writer(data, size);
+                return;
+            }
+        }
+        std::memcpy(buffer + used, data, size);
+        used += size;
+    }
+
+    void flush() {
+        if (used > 0) writer(buffer, used);
+        used = 0;
+    }
+};
+
+// Per-render state shared by the whole tree walk
+struct RenderPass {
+    const CompiledTemplate& owner;
+    const char* source;
+    TemplateFragmentCache* cache;  // nullptr: render fragments directly
+    bool inChunk = false;          // inside a parallel {{#each}} chunk - nested loops stay serial
+};
+
+// Parallel {{#each}} settings and the worker pool behind them
+namespace {
+std::atomic<size_t> parallelMinItems{0};
+std::atomic<unsigned> parallelThreads{0};
+
+constexpr size_t kMinChunkItems = 256;
+
+class RenderPool {
+public:
+    explicit RenderPool(unsigned threads) {
+        for (unsigned i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~RenderPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        wake_.notify_one();
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                if (stop_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()>> tasks_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+};
+
+RenderPool& renderPool() {
+    static RenderPool pool([] {
+        unsigned threads = parallelThreads.load();
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        // The rendering thread works on chunks too
+        return threads > 1 ? threads - 1 : 1u;
+    }());
+    return pool;
+}
+} // namespace
+
+void TemplateEngine::setParallelEach(size_t minItems, unsigned threads) {
+    parallelThreads.store(threads);
+    parallelMinItems.store(minItems);
+}
+
+size_t TemplateEngine::parallelEachThreshold() {
+    return parallelMinItems.load(std::memory_order_relaxed);
+}
+
+// Helper: write a substituted value. Text is HTML-escaped unless raw; formatted
+// numbers and flags contain nothing to escape.
+template <typename Sink>
+static void appendValue(const TemplateValue& value, bool raw, Sink& out) {
+    if (value.isString()) {
+        const std::string& text = value.text();
+        if (raw) {
+            out.append(text.data(), text.size());
+        } else {
+            HtmlEscape::escape(text.data(), text.size(), [&out](const char* data, size_t size) { out.append(data, size); });
+        }
+        return;
+    }
+    TemplateValue::FormatBuffer buffer;
+    std::string_view text = value.format(buffer);
+    out.append(text.data(), text.size());
+}
+
+template <typename Sink>
+static void renderNodes(const std::vector<CompiledTemplate::Node>& nodes, const RenderPass& pass,
+                        const RenderScope& scope, Sink& out);
+
+// Helper: expand a large {{#each}} in chunks. Pool workers and the calling thread
+// take chunks from a shared counter, each into its own buffer; the buffers are
+// appended in list order once all chunks are done. The caller never waits on a
+// chunk nobody has started, so a busy pool only costs parallelism.
+template <typename Sink>
+static void renderEachParallel(const CompiledTemplate::Node& node, const std::vector<Item>& items,
+                               const RenderPass& pass, const RenderScope& scope, Sink& out) {
+    struct Job {
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+        std::vector<std::string> buffers;
+    };
+
+    RenderPool& pool = renderPool();
+    size_t chunkItems = items.size() / ((pool.size() + 1) * 4) + 1;
+    if (chunkItems < kMinChunkItems) chunkItems = kMinChunkItems;
+    size_t chunkCount = (items.size() + chunkItems - 1) / chunkItems;
+
+    auto job = std::make_shared<Job>();
+    job->buffers.resize(chunkCount);
+    RenderPass chunkPass{pass.owner, pass.source, nullptr, true};
+
+    // Renders chunks until none are left; safe to call after the job is complete
+    auto work = [job, chunkCount, chunkItems, &node, &items, chunkPass, &scope]() {
+        for (size_t chunk = job->next++; chunk < chunkCount; chunk = job->next++) {
+            try {
+                std::string& buffer = job->buffers[chunk];
+                StringSink sink{buffer};
+                size_t end = std::min(items.size(), (chunk + 1) * chunkItems);
+                for (size_t i = chunk * chunkItems; i < end; ++i) {
+                    RenderScope itemScope{items[i].fields, items[i].lists, &scope};
+                    renderNodes(node.children, chunkPass, itemScope, sink);
                 }
-                replacement += itemContent;
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                if (!job->error) job->error = std::current_exception();
             }
+            std::lock_guard<std::mutex> lock(job->mutex);
+            if (++job->done == chunkCount) job->finished.notify_all();
         }
-        
-        result = result.substr(0, pos) + replacement + result.substr(endPos + eachEnd.length());
-        // Don't advance searchPos - replacement might contain more {{#each}} blocks
+    };
+
+    size_t helpers = std::min(pool.size(), chunkCount - 1);
+    for (size_t i = 0; i < helpers; ++i) pool.post(work);
+    work();
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&] { return job->done == chunkCount; });
     }
-    
-    return result;
+    if (job->error) std::rethrow_exception(job->error);
+    for (auto& buffer : job->buffers) out.append(buffer.data(), buffer.size());
+}
+
+template <typename Sink>
+static void renderNodes(const std::vector<CompiledTemplate::Node>& nodes, const RenderPass& pass,
+                        const RenderScope& scope, Sink& out) {
+    using Node = CompiledTemplate::Node;
+    for (const auto& node : nodes) {
+        switch (node.type) {
+            case Node::Type::Text:
+                out.append(pass.source + node.offset, node.length);
+                break;
+
+            case Node::Type::Variable:
+                if (const TemplateValue* value = lookupValue(scope, node.key)) {
+                    appendValue(*value, node.raw, out);
+                }
+                break;
+
+            case Node::Type::If:
+                renderNodes(isTruthy(lookupValue(scope, node.key)) ? node.children : node.elseChildren,
+                            pass, scope, out);
+                break;
+
+            case Node::Type::Each: {
+                const std::vector<Item>* items = lookupList(scope, node.key);
+                if (items == nullptr) break;
+                size_t minItems = parallelMinItems.load(std::memory_order_relaxed);
+                if (minItems > 0 && items->size() >= minItems && !pass.inChunk) {
+                    renderEachParallel(node, *items, pass, scope, out);
+                    break;
+                }
+                for (const auto& item : *items) {
+                    RenderScope itemScope{item.fields, item.lists, &scope};
+                    renderNodes(node.children, pass, itemScope, out);
+                }
+                break;
+            }
+
+            case Node::Type::Fragment: {
+                if (pass.cache == nullptr) {
+                    renderNodes(node.children, pass, scope, out);
+                    break;
+                }
+                TemplateFragmentCache::Values values;
+                values.reserve(node.deps.size());
+                for (TemplateKey key : node.deps) values.push_back(lookupValue(scope, key));
+                if (const std::string* cached = pass.cache->find(pass.owner, node.fragment, values)) {
+                    out.append(cached->data(), cached->size());
+                    break;
+                }
+                std::string rendered;
+                StringSink sink{rendered};
+                renderNodes(node.children, pass, scope, sink);
+                out.append(rendered.data(), rendered.size());
+                pass.cache->store(pass.owner, node.fragment, values, std::move(rendered));
+                break;
+            }
+        }
+    }
+}
+
+std::string CompiledTemplate::render(const TemplateContext& context) const {
+    std::string out;
+    out.reserve(source().size());
+    render(context, out);
+    return out;
+}
+
+void CompiledTemplate::render(const TemplateContext& context, std::string& out) const {
+    StringSink sink{out};
+    RenderScope root{context.variables, context.lists, nullptr};
+    renderNodes(nodes_, RenderPass{*this, source().data(), nullptr}, root, sink);
+}
+
+void CompiledTemplate::render(const TemplateContext& context, fmt::memory_buffer& out) const {
+    MemoryBufferSink sink{out};
+    RenderScope root{context.variables, context.lists, nullptr};
+    renderNodes(nodes_, RenderPass{*this, source().data(), nullptr}, root, sink);
+}
+
+void CompiledTemplate::render(const TemplateContext& context, const Writer& writer) const {
+    WriterSink sink{writer};
+    RenderScope root{context.variables, context.lists, nullptr};
+    renderNodes(nodes_, RenderPass{*this, source().data(), nullptr}, root, sink);
+    sink.flush();
+}
+
+std::string CompiledTemplate::render(const TemplateContext& context, TemplateFragmentCache& cache) const {
+    std::string out;
+    out.reserve(source().size());
+    render(context, out, cache);
+    return out;
+}
+
+void CompiledTemplate::render(const TemplateContext& context, std::string& out, TemplateFragmentCache& cache) const {
+    StringSink sink{out};
+    RenderScope root{context.variables, context.lists, nullptr};
+    renderNodes(nodes_, RenderPass{*this, source().data(), &cache}, root, sink);
+}
+
+std::string TemplateEngine::render(const std::string& templateStr, const TemplateContext& context) {
+    return compile(templateStr).render(context);
+}
+
+std::string TemplateEngine::loadTemplate(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return "";
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
 }
 
 std::string TemplateEngine::getInvoiceTemplate() {
@@ -257,4 +847,48 @@ std::string TemplateEngine::getPurchaseOrderTemplate() {
 
 std::string TemplateEngine::getTabularReportTemplate() {
     return TemplateStrings::getTabularReportTemplate();
-}
\ No newline at end of file
+}
+const CompiledTemplate& TemplateEngine::getCompiledInvoiceTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getInvoiceTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledReportTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getReportTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledLetterTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getLetterTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledSalesSummaryTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getSalesSummaryTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledPurchaseSummaryTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getPurchaseSummaryTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledPoisonOrderTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getPoisonOrderTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledBillingStatementTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getBillingStatementTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledPurchaseOrderTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getPurchaseOrderTable());
+    return compiled;
+}
+
+const CompiledTemplate& TemplateEngine::getCompiledTabularReportTemplate() {
+    static const CompiledTemplate compiled = compile(TemplateStrings::getTabularReportTable());
+    return compiled;
+}
@@ -0,0 +1,157 @@
+#include "template_registry.h"
+#include "logging.hpp"
+#include <fstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+// Helper: built-in template for a file name such as "invoice.html", or nullptr
+static const CompiledTemplate* builtinTemplate(const std::string& name) {
+    struct Builtin {
+        const char* name;
+        const CompiledTemplate& (*get)();
+    };
+    static const Builtin builtins[] = {
+        {"invoice", &TemplateEngine::getCompiledInvoiceTemplate},
+        {"report", &TemplateEngine::getCompiledReportTemplate},
+        {"letter", &TemplateEngine::getCompiledLetterTemplate},
+        {"sales_summary", &TemplateEngine::getCompiledSalesSummaryTemplate},
+        {"purchase_summary", &TemplateEngine::getCompiledPurchaseSummaryTemplate},
+        {"poison_order", &TemplateEngine::getCompiledPoisonOrderTemplate},
+        {"billing_statement", &TemplateEngine::getCompiledBillingStatementTemplate},
+        {"purchase_order", &TemplateEngine::getCompiledPurchaseOrderTemplate},
+        {"tabular_report", &TemplateEngine::getCompiledTabularReportTemplate},
+    };
+    std::string stem = fs::path(name).stem().string();
+    for (const auto& builtin : builtins) {
+        if (stem == builtin.name) return &builtin.get();
+    }
+    return nullptr;
+}
+
+// Helper: read a whole file; false if it cannot be opened or read
+static bool readFile(const fs::path& path, uintmax_t size, std::string& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    out.resize(static_cast<size_t>(size));
+    file.read(out.data(), static_cast<std::streamsize>(out.size()));
+    out.resize(static_cast<size_t>(file.gcount()));
+    return !file.bad();
+}
+
+TemplateRegistry::TemplateRegistry(std::chrono::milliseconds checkInterval)
+    : checkInterval_(checkInterval) {
+}
+
+void TemplateRegistry::addSearchDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    searchDirectories_.push_back(directory);
+    lookups_.clear();
+    ++generation_;
+}
+
+void TemplateRegistry::setOutletDirectory(const std::string& outlet, const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    outletDirectories_[outlet] = directory;
+    lookups_.clear();
+    ++generation_;
+}
+
+void TemplateRegistry::setCheckInterval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkInterval_ = interval;
+}
+
+void TemplateRegistry::invalidate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lookups_.clear();
+    ++generation_;
+}
+
+TemplateRegistry& TemplateRegistry::shared() {
+    static TemplateRegistry registry;
+    return registry;
+}
+
+TemplateRegistry::TemplatePtr TemplateRegistry::get(const std::string& name, const std::string& outlet) {
+    std::string lookupKey = outlet + '\n' + name;
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<fs::path> candidates;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = lookups_.find(lookupKey);
+        if (it != lookups_.end() && now - it->second.checkedAt < checkInterval_) {
+            return it->second.compiled;
+        }
+        candidates = candidatePaths(name, outlet);
+        generation = generation_;
+    }
+
+    // Disk reads and compiling run unlocked, so other documents are not held up
+    TemplatePtr compiled = resolve(name, candidates);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Directories changed meanwhile: the result may come from the old ones, so do not keep it
+    if (generation == generation_) lookups_[lookupKey] = Lookup{compiled, now};
+    return compiled;
+}
+
+std::vector<fs::path> TemplateRegistry::candidatePaths(const std::string& name, const std::string& outlet) const {
+    std::vector<fs::path> candidates;
+    auto outletDir = outletDirectories_.find(outlet);
+    if (!outlet.empty() && outletDir != outletDirectories_.end()) {
+        candidates.push_back(fs::path(outletDir->second) / name);
+    }
+    for (const auto& directory : searchDirectories_) {
+        candidates.push_back(fs::path(directory) / name);
+    }
+    return candidates;
+}
+
+TemplateRegistry::TemplatePtr TemplateRegistry::resolve(const std::string& name, const std::vector<fs::path>& candidates) {
+    for (const auto& path : candidates) {
+        std::error_code ec;
+        if (!fs::is_regular_file(path, ec)) continue;
+        if (TemplatePtr compiled = loadFile(path)) return compiled;
+    }
+
+    if (const CompiledTemplate* builtin = builtinTemplate(name)) {
+        // Built-ins live for the whole process; the pointer owns nothing
+        return TemplatePtr(builtin, [](const CompiledTemplate*) {});
+    }
+    return nullptr;
+}
+
+TemplateRegistry::TemplatePtr TemplateRegistry::loadFile(const fs::path& path) {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) return nullptr;
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec) return nullptr;
+
+    std::string key = path.string();
+    TemplatePtr previous;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = files_.find(key);
+        if (it != files_.end()) {
+            if (it->second.mtime == mtime && it->second.size == size) return it->second.compiled;
+            previous = it->second.compiled;
+        }
+    }
+
+    std::string source;
+    if (!readFile(path, size, source)) {
+        LOG_WARN("Template {} could not be read", key);
+        // Keep serving the previous version rather than failing documents mid-edit
+        return previous;
+    }
+
+    auto compiled = std::make_shared<const CompiledTemplate>(TemplateEngine::compile(source));
+    LOG_INFO("Template {} {} ({} bytes)", key, previous ? "reloaded" : "loaded", source.size());
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_[key] = FileEntry{compiled, mtime, size};
+    return compiled;
+}
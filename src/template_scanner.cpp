@@ -0,0 +1,257 @@
+#include "template_scanner.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TEMPLATE_SCANNER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang compile the vector kernels for their instruction set without
+// raising the baseline of the whole file; MSVC accepts the intrinsics as is.
+#if defined(TEMPLATE_SCANNER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TEMPLATE_SCANNER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TEMPLATE_SCANNER_TARGET(isa)
+#endif
+
+namespace {
+
+std::atomic<int> activeLevel{-1};
+
+// Helper: index of the lowest set bit (mask must be non-zero)
+inline unsigned lowestBit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// Helper: record base + bit for every set bit of mask
+inline void pushBits(uint32_t mask, size_t base, std::vector<size_t>& out) {
+    while (mask != 0) {
+        out.push_back(base + lowestBit(mask));
+        mask &= mask - 1;
+    }
+}
+
+// Helper: start of every "cc" pair at or after begin; memchr sweeps the text
+// between candidates, so sparse text stays cheap without SIMD
+void findPairs(const char* data, size_t begin, size_t size, char c, std::vector<size_t>& out) {
+    const char* end = data + size;
+    for (const char* p = data + begin; p + 1 < end;) {
+        p = static_cast<const char*>(std::memchr(p, c, static_cast<size_t>(end - p - 1)));
+        if (p == nullptr) break;
+        if (p[1] == c) {
+            out.push_back(static_cast<size_t>(p - data));
+            ++p;  // "{{{" holds a second pair one byte on
+        } else {
+            p += 2;
+        }
+    }
+}
+
+void findBracesScalar(const char* data, size_t begin, size_t size,
+                      std::vector<size_t>& opens, std::vector<size_t>& closes) {
+    findPairs(data, begin, size, '{', opens);
+    findPairs(data, begin, size, '}', closes);
+}
+
+// Without vector kernels, searching for each tag's delimiters in turn is
+// cheaper than collecting every brace first
+std::vector<TemplateToken> tokenizeWithFind(std::string_view src) {
+    std::vector<TemplateToken> tokens;
+    size_t pos = 0;
+    while (pos < src.size()) {
+        size_t tagStart = src.find("{{", pos);
+        if (tagStart == std::string_view::npos) break;
+        TemplateToken token;
+        token.begin = tagStart;
+        token.raw = tagStart + 2 < src.size() && src[tagStart + 2] == '{';
+        size_t close = src.find(token.raw ? "}}}" : "}}", token.innerBegin());
+        if (close == std::string_view::npos) break;  // unterminated - the rest is text
+        token.end = close + (token.raw ? 3 : 2);
+        tokens.push_back(token);
+        pos = token.end;
+    }
+    return tokens;
+}
+
+#ifdef TEMPLATE_SCANNER_X86
+
+// Each block is compared with the same bytes shifted by one, so a set bit in
+// (block == '{') & (next == '{') marks the start of a "{{" pair. The main loops
+// take two blocks per step and skip both unless one of them holds a brace.
+TEMPLATE_SCANNER_TARGET("sse2")
+inline void scanBlockSSE2(const char* data, size_t i, std::vector<size_t>& opens, std::vector<size_t>& closes) {
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+    pushBits(static_cast<uint32_t>(_mm_movemask_epi8(
+                 _mm_and_si128(_mm_cmpeq_epi8(block, open), _mm_cmpeq_epi8(next, open)))), i, opens);
+    pushBits(static_cast<uint32_t>(_mm_movemask_epi8(
+                 _mm_and_si128(_mm_cmpeq_epi8(block, close), _mm_cmpeq_epi8(next, close)))), i, closes);
+}
+
+TEMPLATE_SCANNER_TARGET("sse2")
+void findBracesSSE2(const char* data, size_t size, std::vector<size_t>& opens, std::vector<size_t>& closes) {
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    size_t i = 0;
+    for (; i + 32 < size; i += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        __m128i any = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lo, open), _mm_cmpeq_epi8(lo, close)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(hi, open), _mm_cmpeq_epi8(hi, close)));
+        if (_mm_movemask_epi8(any) == 0) continue;
+        scanBlockSSE2(data, i, opens, closes);
+        scanBlockSSE2(data, i + 16, opens, closes);
+    }
+    for (; i + 16 < size; i += 16) scanBlockSSE2(data, i, opens, closes);
+    findBracesScalar(data, i, size, opens, closes);
+}
+
+TEMPLATE_SCANNER_TARGET("avx2")
+inline void scanBlockAVX2(const char* data, size_t i, std::vector<size_t>& opens, std::vector<size_t>& closes) {
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+    pushBits(static_cast<uint32_t>(_mm256_movemask_epi8(
+                 _mm256_and_si256(_mm256_cmpeq_epi8(block, open), _mm256_cmpeq_epi8(next, open)))), i, opens);
+    pushBits(static_cast<uint32_t>(_mm256_movemask_epi8(
+                 _mm256_and_si256(_mm256_cmpeq_epi8(block, close), _mm256_cmpeq_epi8(next, close)))), i, closes);
+}
+
+TEMPLATE_SCANNER_TARGET("avx2")
+void findBracesAVX2(const char* data, size_t size, std::vector<size_t>& opens, std::vector<size_t>& closes) {
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    size_t i = 0;
+    for (; i + 64 < size; i += 64) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lo, open), _mm256_cmpeq_epi8(lo, close)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(hi, open), _mm256_cmpeq_epi8(hi, close)));
+        if (_mm256_testz_si256(any, any)) continue;
+        scanBlockAVX2(data, i, opens, closes);
+        scanBlockAVX2(data, i + 32, opens, closes);
+    }
+    for (; i + 32 < size; i += 32) scanBlockAVX2(data, i, opens, closes);
+    findBracesScalar(data, i, size, opens, closes);
+}
+
+// Helper: CPU feature probe (AVX2 also needs the OS to save YMM registers)
+TemplateScanner::Level probeCpu() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse2 = __builtin_cpu_supports("sse2");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) return TemplateScanner::Level::AVX2;
+    if (sse2) return TemplateScanner::Level::SSE2;
+    return TemplateScanner::Level::Scalar;
+}
+
+#else
+
+TemplateScanner::Level probeCpu() {
+    return TemplateScanner::Level::Scalar;
+}
+
+#endif
+
+} // namespace
+
+TemplateScanner::Level TemplateScanner::detectedLevel() {
+    static const Level detected = probeCpu();
+    return detected;
+}
+
+TemplateScanner::Level TemplateScanner::level() {
+    int current = activeLevel.load(std::memory_order_relaxed);
+    return current < 0 ? detectedLevel() : static_cast<Level>(current);
+}
+
+void TemplateScanner::setLevel(Level level) {
+    if (static_cast<int>(level) > static_cast<int>(detectedLevel())) level = detectedLevel();
+    activeLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+const char* TemplateScanner::levelName(Level level) {
+    switch (level) {
+        case Level::AVX2: return "avx2";
+        case Level::SSE2: return "sse2";
+        case Level::Scalar: break;
+    }
+    return "scalar";
+}
+
+void TemplateScanner::findBraces(std::string_view src, std::vector<size_t>& opens, std::vector<size_t>& closes,
+                                 Level level) {
+    opens.clear();
+    closes.clear();
+    if (static_cast<int>(level) > static_cast<int>(detectedLevel())) level = detectedLevel();
+#ifdef TEMPLATE_SCANNER_X86
+    if (level == Level::AVX2) return findBracesAVX2(src.data(), src.size(), opens, closes);
+    if (level == Level::SSE2) return findBracesSSE2(src.data(), src.size(), opens, closes);
+#endif
+    findBracesScalar(src.data(), 0, src.size(), opens, closes);
+}
+
+std::vector<TemplateToken> TemplateScanner::tokenize(std::string_view src, Level level) {
+    if (static_cast<int>(level) > static_cast<int>(detectedLevel())) level = detectedLevel();
+    if (level == Level::Scalar) return tokenizeWithFind(src);
+
+    std::vector<size_t> opens;
+    std::vector<size_t> closes;
+    findBraces(src, opens, closes, level);
+
+    std::vector<TemplateToken> tokens;
+    tokens.reserve(opens.size() < closes.size() ? opens.size() : closes.size());
+
+    // Pair each "{{" with the first "}}" after it ("}}}" for triple-brace tags).
+    // Both cursors only move forward, since every search starts past the last tag.
+    size_t pos = 0;
+    size_t o = 0;
+    size_t c = 0;
+    while (true) {
+        while (o < opens.size() && opens[o] < pos) ++o;
+        if (o == opens.size()) break;
+
+        TemplateToken token;
+        token.begin = opens[o];
+        token.raw = token.begin + 2 < src.size() && src[token.begin + 2] == '{';
+        size_t from = token.innerBegin();
+        while (c < closes.size() &&
+               (closes[c] < from || (token.raw && (closes[c] + 2 >= src.size() || src[closes[c] + 2] != '}')))) {
+            ++c;
+        }
+        if (c == closes.size()) break;  // unterminated - the rest is text
+
+        token.end = closes[c] + (token.raw ? 3 : 2);
+        tokens.push_back(token);
+        pos = token.end;
+    }
+    return tokens;
+}